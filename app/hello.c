@@ -131,18 +131,26 @@ uint8_t green_blinking = 1;
 uart_id_t uart = uart_1;
 char error[] = "Uso: r(ed) g(reen)\n\r";
 
-void uart_rx_callback(void){
-	char c = '\0'; 
-	c = getchar();
-
-	if (c == 'r')
-		red_blinking = !red_blinking;
-	
-	else if (c == 'g')
-		green_blinking = !green_blinking;
-
-	else if (c != '\0')
-		printf(error);
+/*
+ * Se ejecuta desde uart_dispatch_callbacks, fuera de la isr, así que puede
+ * usar la E/S estándar. Procesa de una vez todos los bytes recibidos
+ */
+void uart_rx_callback(uart_id_t id, uint32_t count){
+	char buf[16];
+	ssize_t n, i;
+
+	while ((n = uart_receive(id, buf, sizeof(buf))) > 0){
+		for (i = 0; i < n; i++){
+			if (buf[i] == 'r')
+				red_blinking = !red_blinking;
+
+			else if (buf[i] == 'g')
+				green_blinking = !green_blinking;
+
+			else
+				printf(error);
+		}
+	}
 }
 
 /*
@@ -152,9 +160,12 @@ int main ()
 {
 	gpio_init();
 	uart_set_receive_callback(uart, uart_rx_callback);
+	uart_set_callback_mode(uart, uart_callback_deferred);
 
 	while (1)
 	{
+		uart_dispatch_callbacks();
+
 		pause();
 		if (red_blinking)
 			leds_on(led_red_mask);
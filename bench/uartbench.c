@@ -0,0 +1,311 @@
+/*****************************************************************************/
+/*                                                                           */
+/* Sistemas Empotrados                                                       */
+/* Banco de pruebas de las uart en la Redwire EconoTAG                       */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "system.h"
+
+/*
+ * Cada uart se prueba con su bucle interno (bit TST), para todos los
+ * baudrates y configuraciones, y el informe se envía por la otra uart.
+ * Para cada prueba se mide:
+ *  - bytes/s recibidos
+ *  - interrupciones de la uart por KB
+ *  - porcentaje de CPU consumido por la isr (y las callbacks, que se
+ *    ejecutan en ella), comparando las vueltas del bucle ocioso con las que
+ *    da sin tráfico
+ */
+
+/*
+ * Constantes de la prueba
+ */
+
+/* Bytes transmitidos en cada prueba */
+#define BENCH_BYTES		4096
+
+/* Duración de la calibración del bucle ocioso, en ciclos de BSP_TICK_TIMER */
+#define BENCH_CALIBRATION	(CPU_FREQ / 10)
+
+/* Caracteres que se esperan tras abortar una prueba: la FIFO de transmisión y margen */
+#define BENCH_SETTLE_CHARS	40
+
+static const uint32_t bench_baudrates[] = {
+		9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+
+#define BENCH_BAUDRATES		(sizeof(bench_baudrates) / sizeof(bench_baudrates[0]))
+
+/*
+ * Configuraciones probadas: umbral de recepción y camino de transmisión
+ */
+typedef struct
+{
+	const char *name;
+	uart_rx_threshold_t threshold;
+	uint32_t async;		/* Transmite con un descriptor en vez de con el búfer */
+} bench_config_t;
+
+static const bench_config_t bench_configs[] = {
+		{ "umbral 1, bufer",		{ 1, 1, 0 },	0 },
+		{ "umbral 1-16, bufer",		{ 1, 16, 4 },	0 },
+		{ "umbral 1-24, bufer",		{ 1, 24, 4 },	0 },
+		{ "umbral 1-24, desc.",		{ 1, 24, 4 },	1 } };
+
+#define BENCH_CONFIGS		(sizeof(bench_configs) / sizeof(bench_configs[0]))
+
+/*
+ * Estado de la prueba en curso. Lo actualizan las callbacks desde la isr
+ */
+static uint8_t bench_data[BENCH_BYTES];
+static uart_tx_desc_t bench_desc;
+static volatile uint32_t bench_sent;
+static volatile uint32_t bench_received;
+static volatile uint32_t bench_errors;
+
+/* Vueltas del bucle ocioso en BENCH_CALIBRATION ciclos sin tráfico */
+static uint32_t bench_idle_calibration;
+
+/*****************************************************************************/
+
+/*
+ * Envía un mensaje con formato por una uart y espera a que salga, para que
+ * su isr no interfiera con la siguiente prueba
+ * @param uart	Uart de salida
+ * @param fmt	Formato, como en printf
+ */
+static void bench_report (uart_id_t uart, const char *fmt, ...)
+{
+	char line[128];
+	va_list ap;
+	ssize_t n, i, w;
+	int32_t space = uart_get_tx_space(uart);
+
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+
+	if (n > (ssize_t) sizeof(line) - 1)
+		n = sizeof(line) - 1;
+
+	for (i = 0; i < n; i += w)
+		if ((w = uart_send(uart, line + i, n - i)) < 0)
+			break;
+
+	while (uart_get_tx_space(uart) < space);
+}
+
+/*****************************************************************************/
+
+/*
+ * Callback de recepción. Comprueba los bytes recibidos con los enviados
+ */
+static void bench_rx_callback (uart_id_t uart, uint32_t count)
+{
+	char buf[32];
+	ssize_t n, i;
+
+	while ((n = uart_receive(uart, buf, sizeof(buf))) > 0){
+		for (i = 0; i < n; i++){
+			if (bench_received >= BENCH_BYTES || (uint8_t) buf[i] != bench_data[bench_received])
+				bench_errors++;
+			bench_received++;
+		}
+	}
+}
+
+/*****************************************************************************/
+
+/*
+ * Callback de transmisión. Rellena el búfer de transmisión desde la isr, así
+ * que el programa principal no hace nada durante la prueba
+ */
+static void bench_tx_callback (uart_id_t uart, uint32_t count)
+{
+	ssize_t n;
+
+	if (bench_sent < BENCH_BYTES &&
+		(n = uart_send(uart, (char *) bench_data + bench_sent, BENCH_BYTES - bench_sent)) > 0)
+			bench_sent += n;
+}
+
+/*****************************************************************************/
+
+/*
+ * Bucle ocioso. Da vueltas hasta recibir todos los bytes o agotar el plazo
+ * @param limit		Plazo en ciclos de BSP_TICK_TIMER
+ * @param elapsed	Ciclos transcurridos
+ * @return	El número de vueltas
+ */
+static uint32_t bench_idle (uint32_t limit, uint32_t *elapsed)
+{
+	uint32_t loops = 0;
+	uint16_t last = tmr_read(BSP_TICK_TIMER), now;
+
+	*elapsed = 0;
+	while (bench_received < BENCH_BYTES && *elapsed < limit){
+		now = tmr_read(BSP_TICK_TIMER);
+		*elapsed += (uint16_t) (now - last);
+		last = now;
+		loops++;
+	}
+
+	return loops;
+}
+
+/*****************************************************************************/
+
+/*
+ * Espera un tiempo fijo
+ * @param ticks		Plazo en ciclos de BSP_TICK_TIMER
+ */
+static void bench_wait (uint32_t ticks)
+{
+	uint32_t elapsed = 0;
+	uint16_t last = tmr_read(BSP_TICK_TIMER), now;
+
+	while (elapsed < ticks){
+		now = tmr_read(BSP_TICK_TIMER);
+		elapsed += (uint16_t) (now - last);
+		last = now;
+	}
+}
+
+/*****************************************************************************/
+
+/*
+ * Ejecuta una prueba y envía el resultado por la otra uart
+ * @param uart	Uart en prueba
+ * @param out	Uart para el informe
+ * @param br	Baudrate
+ * @param cfg	Configuración
+ */
+static void bench_run (uart_id_t uart, uart_id_t out, uint32_t br, const bench_config_t *cfg)
+{
+	uart_stats_t stats;
+	uint32_t loops, elapsed, limit, rate, isr_kb, cpu;
+
+	uart_set_baudrate(uart, br, 0);
+	uart_set_rx_threshold(uart, &cfg->threshold);
+
+	bench_sent = 0;
+	bench_received = 0;
+	bench_errors = 0;
+	uart_reset_stats(uart);
+
+	/* El doble del tiempo teórico más un margen */
+	limit = (uint64_t) BENCH_BYTES * 10 * 2 * CPU_FREQ / br + BENCH_CALIBRATION;
+
+	if (cfg->async){
+		bench_desc.buf = (const char *) bench_data;
+		bench_desc.len = BENCH_BYTES;
+		bench_desc.done = 0;
+		bench_sent = BENCH_BYTES;
+		uart_send_async(uart, &bench_desc);
+	}
+	else{
+		/*
+		 * La isr no debe llamar a la callback antes de que bench_sent
+		 * refleje lo que ya está en el búfer
+		 */
+		itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+		bench_sent = uart_send(uart, (char *) bench_data, BENCH_BYTES);
+		uart_set_send_callback(uart, bench_tx_callback);
+		itc_exit_critical(t);
+	}
+
+	loops = bench_idle(limit, &elapsed);
+
+	uart_set_send_callback(uart, 0);
+	uart_get_stats(uart, &stats);
+
+	/*
+	 * Si se ha agotado el plazo, descartamos lo pendiente para que no pase a
+	 * la siguiente prueba y esperamos a que salga lo que queda en la FIFO
+	 */
+	if (bench_received < BENCH_BYTES){
+		uart_cancel_tx(uart);
+		bench_wait((uint64_t) BENCH_SETTLE_CHARS * 10 * CPU_FREQ / br);
+	}
+
+	rate = elapsed ? (uint64_t) bench_received * CPU_FREQ / elapsed : 0;
+	isr_kb = bench_received ? (uint64_t) stats.interrupts * 1024 / bench_received : 0;
+
+	/* Las vueltas que faltan respecto a la calibración son tiempo de isr, en décimas de % */
+	cpu = elapsed ? (uint64_t) loops * BENCH_CALIBRATION * 1000 /
+		((uint64_t) bench_idle_calibration * elapsed) : 1000;
+	cpu = cpu < 1000 ? 1000 - cpu : 0;
+
+	/* Los bytes que no han llegado también son errores */
+	if (bench_received < BENCH_BYTES)
+		bench_errors += BENCH_BYTES - bench_received;
+
+	bench_report(out, "uart%u %7lu  %-20s %7lu B/s %5lu isr/KB  isr %3lu.%lu%%  errores %lu\r\n",
+			(unsigned) uart + 1, (unsigned long) br, cfg->name, (unsigned long) rate,
+			(unsigned long) isr_kb, (unsigned long) (cpu / 10), (unsigned long) (cpu % 10),
+			(unsigned long) bench_errors);
+}
+
+/*****************************************************************************/
+
+/*
+ * Prueba una uart con todos los baudrates y configuraciones
+ * @param uart	Uart en prueba
+ * @param out	Uart para el informe
+ * @param br	Baudrate que se restaura al terminar
+ * @param thr	Umbral de recepción que se restaura al terminar
+ */
+static void bench_uart (uart_id_t uart, uart_id_t out, uint32_t br, const uart_rx_threshold_t *thr)
+{
+	uint32_t i, j;
+
+	uart_set_receive_callback(uart, bench_rx_callback);
+	uart_set_callback_mode(uart, uart_callback_isr);
+	uart_set_loopback(uart, 1);
+
+	for (i = 0; i < BENCH_BAUDRATES; i++)
+		for (j = 0; j < BENCH_CONFIGS; j++)
+			bench_run(uart, out, bench_baudrates[i], &bench_configs[j]);
+
+	uart_set_loopback(uart, 0);
+	uart_set_receive_callback(uart, 0);
+	uart_set_baudrate(uart, br, 0);
+	uart_set_rx_threshold(uart, thr);
+}
+
+/*****************************************************************************/
+
+/*
+ * Programa principal
+ */
+int main ()
+{
+	static const uart_rx_threshold_t uart1_threshold = {
+			UART1_RX_LEVEL_MIN, UART1_RX_LEVEL_MAX, UART1_RX_TIMEOUT };
+	static const uart_rx_threshold_t uart2_threshold = {
+			UART2_RX_LEVEL_MIN, UART2_RX_LEVEL_MAX, UART2_RX_TIMEOUT };
+	uint32_t i, elapsed;
+
+	for (i = 0; i < BENCH_BYTES; i++)
+		bench_data[i] = i * 7 + (i >> 8);
+
+	/* Calibramos el bucle ocioso sin tráfico en ninguna uart */
+	bench_received = 0;
+	bench_idle_calibration = bench_idle(BENCH_CALIBRATION, &elapsed);
+
+	bench_report(uart_1, "Banco de pruebas de las uart: %u bytes por prueba\r\n", (unsigned) BENCH_BYTES);
+	bench_uart(uart_2, uart_1, UART2_BAUDRATE, &uart2_threshold);
+
+	bench_report(uart_2, "Banco de pruebas de las uart: %u bytes por prueba\r\n", (unsigned) BENCH_BYTES);
+	bench_uart(uart_1, uart_2, UART1_BAUDRATE, &uart1_threshold);
+
+	bench_report(uart_1, "Fin\r\n");
+
+	while (1);
+	return 0;
+}
+
+/*****************************************************************************/
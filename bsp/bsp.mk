@@ -29,6 +29,11 @@ BSP_INCLUDE_DIRS = $(sort $(dir $(shell find $(BSP_ROOT_DIR) -name '*.h' -print)
 BSP_CFLAGS     = $(addprefix -I, $(BSP_INCLUDE_DIRS))
 BSP_ASFLAGS    = $(addprefix -I, $(BSP_INCLUDE_DIRS))
 
+# Perfilado de las fuentes de interrupción del ITC. Con 0 desaparece por completo
+ITC_PROFILING  ?= 0
+BSP_CFLAGS     += -DITC_PROFILING=$(ITC_PROFILING)
+BSP_ASFLAGS    += --defsym ITC_PROFILING=$(ITC_PROFILING)
+
 # Añadimos la biblioteca generada por el BSP a la lista de bibliotecas
 BSP_LDFLAGS    = -T$(BSP_LINKER_SCRIPT) -L$(BSP_ROOT_DIR)
 BSP_LIBS       = -l$(BSP)
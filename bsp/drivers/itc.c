@@ -5,6 +5,11 @@
 
 #include "system.h"
 
+#if ITC_PROFILING
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
 /*****************************************************************************/
 
 /**
@@ -29,12 +34,51 @@ typedef struct
 
 static volatile itc_regs_t* const itc_regs = ITC_BASE;
 
+/**
+ * Entrada de la tabla de manejadores de interrupción
+ */
+typedef struct
+{
+	void *ctx;
+	itc_ctx_handler_t handler;
+} itc_vector_t;
+
 /**
  * Tabla de manejadores de interrupción.
+ * Los manejadores en ensamblador de excep_irq.s la indexan directamente con
+ * NIVECTOR, así que cada entrada ocupa 8 bytes y el contexto va primero
  */
-static itc_handler_t itc_handlers[itc_src_max];
+itc_vector_t itc_vectors[itc_src_max];
 
 static u_int32_t saved_int_status = 0;
+static u_int32_t disable_ints_depth = 0;
+
+/**
+ * Los tokens de itc_enter_critical_level llevan este bit para distinguirlos de
+ * los conjuntos de fuentes
+ */
+#define __ITC_TOKEN_LEVEL__		(1u << 31)
+
+#if ITC_PROFILING
+
+/**
+ * Perfiles de las fuentes de interrupción
+ */
+static volatile itc_profile_t itc_profiles[itc_src_max];
+
+/**
+ * Nombres de las fuentes para itc_dump_profile
+ */
+static const char * const itc_src_names[itc_src_max] = {
+		"asm", "uart1", "uart2", "crm", "i2c", "tmr",
+		"spif", "maca", "ssi", "adc", "spi" };
+
+#endif
+
+/**
+ * Valor de NIMASK que no enmascara ninguna prioridad
+ */
+#define __ITC_NIMASK_NONE__		0x1f
 
 /*****************************************************************************/
 
@@ -47,11 +91,13 @@ static u_int32_t saved_int_status = 0;
 inline void itc_init ()
 {
 	for (int i = 0; i < itc_src_max; ++i){
-		itc_handlers[i] = 0;
+		itc_vectors[i].ctx = 0;
+		itc_vectors[i].handler = 0;
 	}
 	
 	itc_regs->INTFRC = 0;
 	itc_regs->INTENABLE = 0;
+	itc_regs->NIMASK = __ITC_NIMASK_NONE__;
 	itc_regs->INTCNTL &= ~(3 << 19);
 }
 
@@ -59,12 +105,19 @@ inline void itc_init ()
 
 /**
  * Deshabilita el envío de peticiones de interrupción a la CPU
- * Permite implementar regiones críticas en modo USER
+ * Permite implementar regiones críticas en modo USER. Las llamadas se pueden
+ * anidar: sólo la última llamada a itc_restore_ints vuelve a habilitarlas.
+ * Es preferible usar itc_enter_critical_level o itc_enter_critical_sources,
+ * que sólo retienen las fuentes que compiten por los datos
  */
 inline void itc_disable_ints ()
 {
-	saved_int_status = itc_regs->INTENABLE;
+	uint32_t enabled = itc_regs->INTENABLE;
+
+	/* Con todas las fuentes deshabilitadas nadie más puede tocar el contador */
 	itc_regs->INTENABLE = 0;
+	if (disable_ints_depth++ == 0)
+		saved_int_status = enabled;
 }
 
 /*****************************************************************************/
@@ -76,20 +129,118 @@ inline void itc_disable_ints ()
 inline void itc_restore_ints ()
 {
 	/* ESTA FUNCIÓN SE DEFINIRÁ EN LA PRÁCTICA 6 */
-	itc_regs->INTENABLE = saved_int_status;
+	if (disable_ints_depth > 0 && --disable_ints_depth == 0)
+		itc_regs->INTENABLE = saved_int_status;
+}
+
+/*****************************************************************************/
+
+/**
+ * Entra en una sección crítica enmascarando con NIMASK las fuentes normales de
+ * prioridad igual o inferior a level. Las fuentes de más prioridad y las
+ * rápidas siguen interrumpiendo. Si ya había un nivel mayor enmascarado se
+ * mantiene, por lo que las secciones críticas se pueden anidar
+ * @param level		Prioridad máxima enmascarada. ITC_LEVEL_ALL enmascara
+ * 					todas las fuentes normales
+ * @return	Token que se debe pasar a itc_exit_critical
+ */
+inline itc_token_t itc_enter_critical_level (uint32_t level)
+{
+	uint32_t prev = itc_regs->NIMASK;
+
+	/*
+	 * __ITC_NIMASK_NONE__ equivale a -1. Si nos interrumpen entre la lectura y
+	 * la escritura, el manejador anidado deja NIMASK como lo encontró
+	 */
+	if (prev == __ITC_NIMASK_NONE__ || level > prev)
+		itc_regs->NIMASK = level;
+
+	return __ITC_TOKEN_LEVEL__ | prev;
+}
+
+/*****************************************************************************/
+
+/**
+ * Entra en una sección crítica deshabilitando un conjunto de fuentes, normales
+ * o rápidas. Las secciones críticas se pueden anidar
+ * @param sources	Conjunto de fuentes, construido con ITC_SRC
+ * @return	Token que se debe pasar a itc_exit_critical
+ */
+inline itc_token_t itc_enter_critical_sources (uint32_t sources)
+{
+	/* Sólo hay que volver a habilitar las que estaban habilitadas */
+	itc_token_t token = itc_regs->INTENABLE & sources;
+
+	for (uint32_t src = 0; src < itc_src_max; ++src)
+		if (token & ITC_SRC(src))
+			itc_regs->INTDISNUM = src;
+
+	return token;
+}
+
+/*****************************************************************************/
+
+/**
+ * Sale de una sección crítica restaurando el estado anterior del ITC
+ * Las secciones anidadas deben cerrarse en orden inverso al de entrada
+ * @param token		Token retornado al entrar en la sección crítica
+ */
+inline void itc_exit_critical (itc_token_t token)
+{
+	if (token & __ITC_TOKEN_LEVEL__)
+		itc_regs->NIMASK = token & __ITC_NIMASK_NONE__;
+
+	else
+		for (uint32_t src = 0; src < itc_src_max; ++src)
+			if (token & ITC_SRC(src))
+				itc_regs->INTENNUM = src;
+}
+
+/*****************************************************************************/
+
+/**
+ * Invoca un manejador sin contexto guardado como contexto de la entrada
+ * Llamar a un void (*)(void) a través de un itc_ctx_handler_t tendría un
+ * comportamiento indefinido
+ * @param ctx	Manejador sin contexto
+ */
+static void itc_call_void (void *ctx)
+{
+	((itc_handler_t) ctx) ();
 }
 
 /*****************************************************************************/
 
 /**
  * Asigna un manejador de interrupción
+ * Los manejadores del propio BSP usan itc_set_handler_ctx, que se ahorra la
+ * llamada intermedia
  * @param src		Identificador de la fuente
  * @param handler	Manejador
  */
 inline void itc_set_handler (itc_src_t src, itc_handler_t handler)
 {
 	/* ESTA FUNCIÓN SE DEFINIRÁ EN LA PRÁCTICA 6 */
-	itc_handlers[src] = handler;
+	if (handler)
+		itc_set_handler_ctx (src, itc_call_void, (void *) handler);
+	else
+		itc_set_handler_ctx (src, 0, 0);
+}
+
+/*****************************************************************************/
+
+/**
+ * Asigna un manejador de interrupción que recibe un contexto
+ * Permite que un mismo manejador atienda varias fuentes sin necesidad de una
+ * función intermedia por fuente
+ * @param src		Identificador de la fuente
+ * @param handler	Manejador
+ * @param ctx		Contexto que recibirá el manejador como argumento
+ */
+inline void itc_set_handler_ctx (itc_src_t src, itc_ctx_handler_t handler, void *ctx)
+{
+	itc_vectors[src].ctx = ctx;
+	itc_vectors[src].handler = handler;
 }
 
 /*****************************************************************************/
@@ -104,7 +255,7 @@ inline void itc_set_priority (itc_src_t src, itc_priority_t priority)
 	switch (priority)
 	{
 	case itc_priority_fast:
-		itc_regs->INTTYPE = (1 << src);
+		itc_regs->INTTYPE = itc_regs->INTTYPE | (1 << src);
 		break;
 	
 	case itc_priority_normal:
@@ -169,7 +320,13 @@ inline void itc_unforce_interrupt (itc_src_t src)
  */
 void itc_service_normal_interrupt ()
 {
-	itc_handlers[itc_regs->NIVECTOR]();
+#if ITC_PROFILING
+	itc_profile_dispatch (itc_regs->NIVECTOR, tmr_read (BSP_PROFILE_TIMER));
+#else
+	itc_vector_t *vector = &itc_vectors[itc_regs->NIVECTOR];
+
+	vector->handler(vector->ctx);
+#endif
 }
 
 /*****************************************************************************/
@@ -179,7 +336,124 @@ void itc_service_normal_interrupt ()
  */
 void itc_service_fast_interrupt ()
 {
-	itc_handlers[itc_regs->FIVECTOR]();
+#if ITC_PROFILING
+	itc_profile_dispatch (itc_regs->FIVECTOR, tmr_read (BSP_PROFILE_TIMER));
+#else
+	itc_vector_t *vector = &itc_vectors[itc_regs->FIVECTOR];
+
+	vector->handler(vector->ctx);
+#endif
+}
+
+/*****************************************************************************/
+
+#if ITC_PROFILING
+
+/**
+ * Llama al manejador de una fuente y actualiza su perfil
+ * La usan los manejadores de excepción en lugar de saltar directamente al
+ * manejador cuando el perfilado está activo
+ * @param src		Identificador de la fuente
+ * @param entry		Cuenta de BSP_PROFILE_TIMER al entrar en la excepción
+ */
+void itc_profile_dispatch (itc_src_t src, uint32_t entry)
+{
+	itc_vector_t *vector = &itc_vectors[src];
+	volatile itc_profile_t *profile = &itc_profiles[src];
+	uint16_t start = tmr_read (BSP_PROFILE_TIMER);
+	uint32_t latency = (uint32_t) (uint16_t) (start - entry) << BSP_PROFILE_DIV;
+	uint32_t cycles;
+
+	vector->handler(vector->ctx);
+
+	/* Las diferencias son de 16 bits en cuentas del temporizador; las pasamos a ciclos */
+	cycles = (uint32_t) (uint16_t) (tmr_read (BSP_PROFILE_TIMER) - start) << BSP_PROFILE_DIV;
+
+	/* Una fuente no interrumpe a su propio manejador, así que nadie más toca su perfil */
+	profile->count++;
+	profile->total_cycles += cycles;
+	if (cycles > profile->max_cycles)
+		profile->max_cycles = cycles;
+	profile->total_latency += latency;
+	if (latency > profile->max_latency)
+		profile->max_latency = latency;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el perfil de una fuente de interrupción
+ * @param src		Identificador de la fuente
+ * @param profile	Estructura donde se copia el perfil
+ */
+void itc_get_profile (itc_src_t src, itc_profile_t *profile)
+{
+	/* Copiamos el perfil sin que la fuente lo actualice a medias */
+	itc_token_t t = itc_enter_critical_sources (ITC_SRC(src));
+
+	profile->count = itc_profiles[src].count;
+	profile->total_cycles = itc_profiles[src].total_cycles;
+	profile->max_cycles = itc_profiles[src].max_cycles;
+	profile->total_latency = itc_profiles[src].total_latency;
+	profile->max_latency = itc_profiles[src].max_latency;
+
+	itc_exit_critical (t);
+}
+
+/*****************************************************************************/
+
+/**
+ * Reinicia los perfiles de todas las fuentes de interrupción
+ */
+void itc_reset_profile ()
+{
+	/* Ninguna fuente normal debe actualizar su perfil mientras lo borramos */
+	itc_token_t t = itc_enter_critical_level (ITC_LEVEL_ALL);
+
+	for (int i = 0; i < itc_src_max; ++i){
+		itc_profiles[i].count = 0;
+		itc_profiles[i].total_cycles = 0;
+		itc_profiles[i].max_cycles = 0;
+		itc_profiles[i].total_latency = 0;
+		itc_profiles[i].max_latency = 0;
+	}
+
+	itc_exit_critical (t);
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe una tabla con los perfiles de las fuentes atendidas en un
+ * descriptor de fichero, p.ej. el de una uart
+ * @param fd		Descriptor de fichero
+ */
+void itc_dump_profile (int fd)
+{
+	itc_profile_t profile;
+	char line[96];
+	int len;
+
+	len = snprintf (line, sizeof(line), "%-6s %10s %10s %8s %8s %8s %8s\r\n",
+			"src", "count", "cycles", "avg", "max", "lat.avg", "lat.max");
+	write (fd, line, len);
+
+	for (int i = 0; i < itc_src_max; ++i){
+		itc_get_profile (i, &profile);
+		if (profile.count == 0)
+			continue;
+
+		len = snprintf (line, sizeof(line), "%-6s %10lu %10lu %8lu %8lu %8lu %8lu\r\n",
+				itc_src_names[i], (unsigned long) profile.count,
+				(unsigned long) profile.total_cycles,
+				(unsigned long) (profile.total_cycles / profile.count),
+				(unsigned long) profile.max_cycles,
+				(unsigned long) (profile.total_latency / profile.count),
+				(unsigned long) profile.max_latency);
+		write (fd, line, len);
+	}
 }
 
+#endif /* ITC_PROFILING */
+
 /*****************************************************************************/
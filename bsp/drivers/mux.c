@@ -0,0 +1,288 @@
+/*
+ * Sistemas operativos empotrados
+ * Multiplexación de canales lógicos sobre una uart
+ */
+
+#include <errno.h>
+#include <string.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Búferes de los canales
+ * El programa principal produce y consume en ambos, así que no comparten
+ * nada con las isr
+ */
+static uint8_t mux_rx_memory[mux_max][MUX_RX_BUFFER_SIZE];
+static uint8_t mux_tx_memory[mux_max][MUX_TX_BUFFER_SIZE];
+
+static volatile circular_buffer_t mux_rx_buffers[mux_max];
+static volatile circular_buffer_t mux_tx_buffers[mux_max];
+
+/**
+ * Trama en construcción o recién recibida: canal y datos
+ */
+static uint8_t mux_frame[1 + MUX_MAX_PAYLOAD];
+
+/**
+ * Tamaño máximo de una trama codificada: todos los bytes escapados, más el
+ * CRC y los dos END
+ */
+#define __MUX_MAX_ENCODED__(n)	(2 * ((n) + 1 + 2) + 2)
+
+static uart_id_t mux_uart = uart_max;
+static mux_channel_t mux_next;		/* Primer canal de la siguiente ronda */
+
+/**
+ * Tramas recibidas descartadas por falta de espacio en el canal
+ */
+static uint32_t mux_rx_dropped[mux_max];
+
+/*****************************************************************************/
+
+/**
+ * Inicializa la multiplexación sobre una uart ya inicializada y registra un
+ * dispositivo por canal
+ * Cada trama es una trama SLIP con CRC (ver uart_slip_send) cuyo primer byte
+ * identifica el canal. La uart no debe usarse directamente mientras tanto
+ * @param uart	Identificador de la uart
+ * @param names	Nombres de los dispositivos, uno por canal
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t mux_init (uart_id_t uart, const char * const names[mux_max])
+{
+	mux_channel_t ch;
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (names == 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	for (ch = mux_console; ch < mux_max; ch++){
+		circular_buffer_init(&mux_rx_buffers[ch], mux_rx_memory[ch], MUX_RX_BUFFER_SIZE);
+		circular_buffer_init(&mux_tx_buffers[ch], mux_tx_memory[ch], MUX_TX_BUFFER_SIZE);
+		mux_rx_dropped[ch] = 0;
+	}
+
+	mux_uart = uart;
+	mux_next = mux_console;
+
+	for (ch = mux_console; ch < mux_max; ch++)
+		if (bsp_register_dev(names[ch], ch, 0, 0, mux_read, mux_write, 0, mux_fstat, 0) < 0)
+			return -1;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Mueve las tramas entre la uart y los búferes de los canales
+ * Reparte las tramas recibidas entre los canales y envía como mucho una trama
+ * por canal y ronda mientras quede espacio en la uart, para que un canal con
+ * mucho tráfico no retrase a los demás. Las funciones read y write de los
+ * canales la llaman, pero también debe llamarse periódicamente desde el bucle
+ * del programa principal
+ */
+void mux_poll (void)
+{
+	uint32_t i, ch, sent;
+	volatile circular_buffer_t *cb;
+	ssize_t n;
+
+	if (mux_uart >= uart_max)
+		return;
+
+	/*
+	 * Recepción. Una trama truncada desordenaría el flujo del canal, así que
+	 * si no cabe entera se descarta completa y se contabiliza
+	 */
+	while ((n = uart_slip_receive(mux_uart, (char *) mux_frame, sizeof(mux_frame))) > 0){
+		if (mux_frame[0] >= mux_max)
+			continue;
+
+		cb = &mux_rx_buffers[mux_frame[0]];
+		if (cb->size - circular_buffer_count(cb) < (uint32_t) (n - 1))
+			mux_rx_dropped[mux_frame[0]]++;
+		else
+			circular_buffer_write_span(cb, mux_frame + 1, n - 1);
+	}
+
+	/* Transmisión por turnos */
+	do{
+		sent = 0;
+		for (i = mux_next; i < mux_next + mux_max; i++){
+			ch = i % mux_max;
+			n = circular_buffer_count(&mux_tx_buffers[ch]);
+			if (n == 0)
+				continue;
+
+			if (n > MUX_MAX_PAYLOAD)
+				n = MUX_MAX_PAYLOAD;
+
+			if (uart_get_tx_space(mux_uart) < __MUX_MAX_ENCODED__(n)){
+				/* La uart está llena. El turno sigue siendo de este canal */
+				mux_next = ch;
+				return;
+			}
+
+			mux_frame[0] = ch;
+			circular_buffer_read_span(&mux_tx_buffers[ch], mux_frame + 1, n);
+			uart_slip_send(mux_uart, (char *) mux_frame, n + 1);
+			sent++;
+		}
+	} while (sent);
+}
+
+/*****************************************************************************/
+
+/**
+ * Transmisión por un canal
+ * La llamada es no bloqueante
+ * @param channel	Canal
+ * @param buf		Búfer con los datos
+ * @param count		Número de bytes a escribir
+ * @return	El número de bytes almacenados en el búfer del canal en caso de
+ * 		éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t mux_write (uint32_t channel, char *buf, size_t count)
+{
+	uint32_t i;
+
+	if (channel >= mux_max || mux_uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (buf == 0 || count <= 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	i = circular_buffer_write_span(&mux_tx_buffers[channel], (const uint8_t *) buf, count);
+	mux_poll();
+
+	return i;
+}
+
+/*****************************************************************************/
+
+/**
+ * Recepción por un canal
+ * La llamada es no bloqueante
+ * @param channel	Canal
+ * @param buf		Búfer para almacenar los bytes
+ * @param count		Número de bytes a leer
+ * @return	El número de bytes realmente leídos en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t mux_read (uint32_t channel, char *buf, size_t count)
+{
+	if (channel >= mux_max || mux_uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (buf == 0 || count <= 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	mux_poll();
+
+	return circular_buffer_read_span(&mux_rx_buffers[channel], (uint8_t *) buf, count);
+}
+
+/*****************************************************************************/
+
+/**
+ * Función fstat de los dispositivos de los canales
+ * st_size es el número de bytes que se pueden leer sin esperar y st_blksize
+ * el tamaño del búfer de recepción del canal
+ * @param channel	Canal
+ * @param buf		Estructura stat a rellenar
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int mux_fstat (uint32_t channel, struct stat *buf)
+{
+	if (channel >= mux_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (buf == 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	memset(buf, 0, sizeof(struct stat));
+	buf->st_mode = S_IFCHR;
+	buf->st_rdev = channel;
+	buf->st_size = circular_buffer_count(&mux_rx_buffers[channel]);
+	buf->st_blksize = mux_rx_buffers[channel].size;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna las estadísticas de los búferes de un canal
+ * @param channel	Canal
+ * @param rx		Estadísticas del búfer de recepción. Puede ser NULL
+ * @param tx		Estadísticas del búfer de transmisión. Puede ser NULL
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t mux_get_buffer_stats (mux_channel_t channel, circular_buffer_stats_t *rx, circular_buffer_stats_t *tx)
+{
+	if (channel >= mux_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	if (rx)
+		circular_buffer_get_stats(&mux_rx_buffers[channel], rx);
+
+	if (tx)
+		circular_buffer_get_stats(&mux_tx_buffers[channel], tx);
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de tramas recibidas por un canal que se han descartado
+ * por no caber enteras en su búfer de recepción
+ * @param channel	Canal
+ * @param frames	Tramas descartadas
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t mux_get_dropped_frames (mux_channel_t channel, uint32_t *frames)
+{
+	if (channel >= mux_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (frames == 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	*frames = mux_rx_dropped[channel];
+	return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,234 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para los temporizadores del MC1322x
+ */
+
+#include <errno.h>
+#include "system.h"
+
+/*****************************************************************************/
+
+/**
+ * Acceso estructurado a los registros de un temporizador del MC1322x
+ */
+typedef struct
+{
+	uint16_t COMP1;
+	uint16_t COMP2;
+	uint16_t CAPT;
+	uint16_t LOAD;
+	uint16_t HOLD;
+	uint16_t CNTR;
+
+	union
+	{
+		struct
+		{
+			uint16_t OM			:3;
+			uint16_t Co_INIT	:1;
+			uint16_t DIR		:1;
+			uint16_t LENGTH		:1;
+			uint16_t ONCE		:1;
+			uint16_t SCS		:2;
+			uint16_t PCS		:4;
+			uint16_t CM			:3;
+		};
+		uint16_t CTRL;
+	};
+
+	union
+	{
+		struct
+		{
+			uint16_t OEN		:1;
+			uint16_t OPS		:1;
+			uint16_t FORCE		:1;
+			uint16_t VAL		:1;
+			uint16_t EEOF		:1;
+			uint16_t MSTR		:1;
+			uint16_t CAPTURE_MODE	:2;
+			uint16_t INPUT		:1;
+			uint16_t IPS		:1;
+			uint16_t IEFIE		:1;
+			uint16_t IEF		:1;
+			uint16_t TOFIE		:1;
+			uint16_t TOF		:1;
+			uint16_t TCFIE		:1;
+			uint16_t TCF		:1;
+		};
+		uint16_t SCTRL;
+	};
+
+	uint16_t CMPLD1;
+	uint16_t CMPLD2;
+	uint16_t CSCTRL;
+	uint16_t reserved[4];
+	uint16_t ENBL;		/* Sólo existe en el bloque del temporizador 0 */
+} tmr_regs_t;
+
+/**
+ * Modo de cuenta: flancos de subida de la fuente primaria
+ */
+#define TMR_CM_RISING_EDGES		1
+
+/**
+ * Fuente primaria: reloj del bus dividido por 2^n
+ */
+#define TMR_PCS_BUS_CLK(n)		(0x8 + (n))
+
+/*****************************************************************************/
+
+/**
+ * Definición de los temporizadores
+ */
+#define TMR_BLOCK(n)	((volatile tmr_regs_t *) ((uint8_t *) TMR_BASE + (n) * 0x20))
+
+static volatile tmr_regs_t* const tmr_regs[tmr_max] = {
+		TMR_BLOCK(0), TMR_BLOCK(1), TMR_BLOCK(2), TMR_BLOCK(3) };
+
+static volatile tmr_callback_t tmr_callbacks[tmr_max];
+
+static void tmr_isr (void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los temporizadores. Los deja parados y registra su manejador
+ * de interrupción en el ITC
+ */
+void tmr_init (void)
+{
+	uint32_t i;
+
+	for (i = 0; i < tmr_max; i++){
+		tmr_regs[i]->CTRL = 0;
+		tmr_regs[i]->SCTRL = 0;
+		tmr_regs[i]->CSCTRL = 0;
+		tmr_callbacks[i] = 0;
+	}
+
+	tmr_regs[tmr_0]->ENBL = (1 << tmr_max) - 1;
+
+	itc_set_priority(itc_src_tmr, itc_priority_normal);
+	itc_set_handler_ctx(itc_src_tmr, tmr_isr, 0);
+	itc_enable_interrupt(itc_src_tmr);
+}
+
+/*****************************************************************************/
+
+/**
+ * Arranca un temporizador en modo libre. Cuenta de 0 a 0xffff y vuelve a 0
+ * sin generar interrupciones
+ * @param tmr	Identificador del temporizador
+ * @param div	Divisor del reloj
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_start_free_running (tmr_id_t tmr, tmr_div_t div)
+{
+	if (tmr >= tmr_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (div >= tmr_div_max){
+		errno = EINVAL;
+		return -1;
+	}
+
+	tmr_regs[tmr]->CTRL = 0;
+	tmr_regs[tmr]->SCTRL = 0;
+	tmr_regs[tmr]->LOAD = 0;
+	tmr_regs[tmr]->CNTR = 0;
+	tmr_callbacks[tmr] = 0;
+
+	tmr_regs[tmr]->CTRL = (TMR_CM_RISING_EDGES << 13) | (TMR_PCS_BUS_CLK(div) << 9);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Arranca un temporizador de un solo disparo. Si ya estaba en marcha vuelve
+ * a empezar la cuenta
+ * @param tmr		Identificador del temporizador
+ * @param div		Divisor del reloj
+ * @param ticks		Número de ciclos del reloj dividido hasta el disparo
+ * @param callback	Función invocada desde la isr al vencer la cuenta
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_start_oneshot (tmr_id_t tmr, tmr_div_t div, uint16_t ticks, tmr_callback_t callback)
+{
+	if (tmr >= tmr_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (div >= tmr_div_max || ticks == 0){
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Paramos la cuenta anterior antes de tocar el comparador */
+	tmr_regs[tmr]->CTRL = 0;
+	tmr_regs[tmr]->SCTRL = 0;
+	tmr_regs[tmr]->LOAD = 0;
+	tmr_regs[tmr]->CNTR = 0;
+	tmr_regs[tmr]->COMP1 = ticks;
+	tmr_callbacks[tmr] = callback;
+
+	tmr_regs[tmr]->TCFIE = 1;
+	tmr_regs[tmr]->CTRL = (TMR_CM_RISING_EDGES << 13) | (TMR_PCS_BUS_CLK(div) << 9) |
+			(1 << 6) | (1 << 5);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Detiene un temporizador
+ * @param tmr	Identificador del temporizador
+ */
+void tmr_stop (tmr_id_t tmr)
+{
+	if (tmr < tmr_max){
+		tmr_regs[tmr]->CTRL = 0;
+		tmr_regs[tmr]->SCTRL = 0;
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna la cuenta actual de un temporizador
+ * @param tmr	Identificador del temporizador
+ */
+uint16_t tmr_read (tmr_id_t tmr)
+{
+	return tmr < tmr_max ? tmr_regs[tmr]->CNTR : 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador de interrupciones de los temporizadores
+ * Todos comparten una única fuente en el ITC
+ * @param ctx	Contexto del ITC, no se usa
+ */
+static void tmr_isr (void *ctx)
+{
+	uint32_t i;
+
+	for (i = 0; i < tmr_max; i++){
+		if (tmr_regs[i]->TCF && tmr_regs[i]->TCFIE){
+			/* En modo de un solo disparo el temporizador ya se ha parado */
+			tmr_regs[i]->SCTRL = 0;
+
+			if (tmr_callbacks[i])
+				tmr_callbacks[i](i);
+		}
+	}
+}
+
+/*****************************************************************************/
@@ -5,6 +5,8 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include "system.h"
 #include "circular_buffer.h"
 #include "sys/types.h"
@@ -112,212 +114,1944 @@ static const uart_pins_t uart_pins[uart_max] = {
 		{gpio_pin_14, gpio_pin_15, gpio_pin_16, gpio_pin_17},
 		{gpio_pin_18, gpio_pin_19, gpio_pin_20, gpio_pin_21} };
 
-static void uart_1_isr (void);
-static void uart_2_isr (void);
-static const itc_handler_t uart_irq_handlers[uart_max] = {uart_1_isr, uart_2_isr};
+static void uart_irq_handler (void *ctx);
+
+/**
+ * Manejador rápido en ensamblador (uart_fiq.s) y su camino lento en C
+ */
+void uart_fiq_handler (void);
+uint8_t *uart_fiq_isr (uint32_t status);
+
+/*****************************************************************************/
+
+/**
+ * Tamaño por defecto de los búferes circulares
+ */
+#define __UART_BUFFER_SIZE__	256
+
+static volatile circular_buffer_t uart_circular_rx_buffers[uart_max];
+static volatile circular_buffer_t uart_circular_tx_buffers[uart_max];
+
+/**
+ * Memoria de los búferes de tamaño por defecto sin búfer del usuario
+ */
+static uint8_t uart_rx_memory[uart_max][__UART_BUFFER_SIZE__];
+static uint8_t uart_tx_memory[uart_max][__UART_BUFFER_SIZE__];
+
+/**
+ * Búferes reservados con malloc por uart_init_ex, para liberarlos si se
+ * vuelve a inicializar la uart
+ */
+static uint8_t *uart_rx_heap[uart_max];
+static uint8_t *uart_tx_heap[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Colas de descriptores de transmisión asíncrona.
+ * El programa principal añade por el final y la isr retira por el principio
+ */
+typedef struct
+{
+	uart_tx_desc_t *head;
+	uart_tx_desc_t *tail;
+} uart_tx_queue_t;
+
+static volatile uart_tx_queue_t uart_tx_queues[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Estado del umbral adaptativo de recepción
+ */
+typedef struct
+{
+	uint8_t min_level;
+	uint8_t max_level;
+	uint8_t level;			/* Umbral programado actualmente en la FIFO */
+	uint8_t timeout;		/* La isr debe vaciar la FIFO por silencio en la línea */
+	uint8_t timeout_chars;	/* Duración del silencio en caracteres */
+	uint16_t ticks;			/* Duración del silencio en ciclos del temporizador */
+} uart_rx_threshold_state_t;
+
+/**
+ * Divisor del temporizador de silencio. Con 24 MHz cada ciclo dura 5,3 us
+ */
+#define __UART_RX_TIMER_DIV__	tmr_div_128
+
+static const tmr_id_t uart_rx_timers[uart_max] = {UART1_RX_TIMER, UART2_RX_TIMER};
+
+static volatile uart_rx_threshold_state_t uart_rx_thresholds[uart_max];
+
+static volatile uint32_t uart_baudrates[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Estado del control de flujo
+ */
+typedef struct
+{
+	uart_flow_t mode;
+	uint32_t high;			/* Ocupación del búfer de recepción a la que se detiene la recepción */
+	uint32_t low;			/* Ocupación del búfer de recepción a la que se reanuda */
+	uint32_t max_level;		/* Umbral de recepción máximo compatible con el modo */
+	uint8_t tx_ctrl;		/* Carácter XON/XOFF pendiente de enviar o cero */
+	uint8_t tx_paused;		/* El otro extremo nos ha enviado XOFF */
+	uint8_t rx_stopped;		/* Hemos enviado XOFF al otro extremo */
+} uart_flow_state_t;
+
+/**
+ * Caracteres de control de flujo software
+ */
+#define __UART_XON__			0x11
+#define __UART_XOFF__			0x13
+
+/**
+ * Nivel de la FIFO de recepción al que el hardware desactiva CTS. Deja margen
+ * para los bytes que el otro extremo envíe antes de detenerse
+ */
+#define __UART_CTS_LEVEL__		24
+
+static volatile uart_flow_state_t uart_flows[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Estado de la recepción por tramas
+ * La isr sólo incrementa closed y el programa principal sólo incrementa
+ * released, así que no hace falta enmascarar la interrupción para consumir
+ */
+typedef struct
+{
+	uint8_t *pool;			/* NULL si la uart no está en modo de tramas */
+	uint32_t size;			/* Tamaño de cada trama */
+	uint32_t frames;		/* Número de tramas */
+	uint32_t len;			/* Bytes de la trama en recepción */
+	uint32_t closed;		/* Tramas completadas por la isr */
+	uint32_t released;		/* Tramas liberadas por el programa principal */
+	uint32_t lengths[UART_MAX_FRAMES];
+	uint16_t ticks;			/* Silencio entre tramas, en ciclos del temporizador */
+	uint8_t gap;			/* Silencio entre tramas en caracteres */
+} uart_frame_state_t;
+
+static volatile uart_frame_state_t uart_frames[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Bits de error del registro USTAT
+ */
+#define __UART_USTAT_SE__		(1 << 0)
+#define __UART_USTAT_PE__		(1 << 1)
+#define __UART_USTAT_FE__		(1 << 2)
+#define __UART_USTAT_TOE__		(1 << 3)
+#define __UART_USTAT_ROE__		(1 << 4)
+#define __UART_USTAT_RUE__		(1 << 5)
+#define __UART_USTAT_ERRORS__	0x3f
+
+static volatile uart_stats_t uart_stats[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Estado del modo FIQ. Sólo una uart puede usarlo, porque el manejador rápido
+ * guarda los punteros del búfer de recepción en los registros r8-r12 propios
+ * del modo FIQ
+ */
+typedef struct
+{
+	uart_id_t uart;			/* uart_max si ninguna uart está en modo FIQ */
+	uint32_t end;			/* Índice end del búfer de recepción ya contabilizado en bytes_in */
+} uart_fiq_state_t;
+
+static volatile uart_fiq_state_t uart_fiq = {uart_max, 0};
+
+/*****************************************************************************/
+
+/**
+ * Caracteres especiales de SLIP (RFC 1055)
+ */
+#define __UART_SLIP_END__		0xc0
+#define __UART_SLIP_ESC__		0xdb
+#define __UART_SLIP_ESC_END__	0xdc
+#define __UART_SLIP_ESC_ESC__	0xdd
+
+/**
+ * Valor inicial del CRC-16-CCITT. Con el CRC añadido al final de la trama,
+ * el CRC de la trama completa es cero
+ */
+#define __UART_SLIP_CRC_INIT__	0xffff
+
+/* Bytes del búfer de recepción en los que ya se ha buscado un END sin éxito */
+static uint32_t uart_slip_scanned[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Gestión de las callbacks
+ */
+typedef struct
+{
+	uart_callback_t tx_callback;
+	uart_callback_t rx_callback;
+	uart_callback_mode_t mode;
+	uint8_t tx_pending;		/* Callbacks diferidas pendientes de ejecutar */
+	uint8_t rx_pending;
+} uart_callbacks_t;
+
+static volatile uart_callbacks_t uart_callbacks[uart_max];
+
+/*****************************************************************************/
+
+/**
+ * Detección automática del baudrate
+ */
+#define __UART_AUTOBAUD_PROBE__		20			/* Espera por cada baudrate probado, en ms */
+#define __UART_AUTOBAUD_SYNC__		0x55		/* Carácter de sincronización 'U' */
+
+static const uint32_t uart_autobaud_rates[] = {
+		9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600,
+		1000000, 1500000, 2000000 };
+
+#define __UART_AUTOBAUD_RATES__		(sizeof(uart_autobaud_rates) / sizeof(uart_autobaud_rates[0]))
+
+/*****************************************************************************/
+
+/**
+ * Error máximo admitido en el baudrate, en partes por millón
+ */
+#define __UART_MAX_BAUD_ERROR__	20000
+
+/**
+ * Busca la fracción p/q más próxima a n/d con q <= max mediante fracciones
+ * continuas. Se prueban los convergentes y el último semiconvergente
+ * @param n		Numerador
+ * @param d		Denominador
+ * @param max	Máximo denominador admitido
+ * @param p		Numerador de la fracción elegida
+ * @param q		Denominador de la fracción elegida
+ */
+static void uart_best_ratio (uint32_t n, uint32_t d, uint32_t max, uint32_t *p, uint32_t *q)
+{
+	uint32_t p0 = 0, q0 = 1, p1 = 1, q1 = 0, a, t, k, n0 = n, d0 = d;
+	uint64_t err0, err1;
+
+	while (d != 0){
+		a = n / d;
+		if (q1 != 0 && a > (max - q0) / q1)
+			break;
+
+		t = p0 + a * p1; p0 = p1; p1 = t;
+		t = q0 + a * q1; q0 = q1; q1 = t;
+		t = n - a * d; n = d; d = t;
+	}
+
+	*p = p1;
+	*q = q1;
+
+	/* Si la fracción no es exacta comparamos con el mejor semiconvergente */
+	if (d != 0){
+		k = (max - q0) / q1;
+		p0 += k * p1;
+		q0 += k * q1;
+
+		err0 = (uint64_t) p0 * d0 > (uint64_t) q0 * n0 ?
+			(uint64_t) p0 * d0 - (uint64_t) q0 * n0 : (uint64_t) q0 * n0 - (uint64_t) p0 * d0;
+		err1 = (uint64_t) p1 * d0 > (uint64_t) q1 * n0 ?
+			(uint64_t) p1 * d0 - (uint64_t) q1 * n0 : (uint64_t) q1 * n0 - (uint64_t) p1 * d0;
+
+		/* |p0/q0 - n/d| < |p1/q1 - n/d| */
+		if (err0 * q1 < err1 * q0){
+			*p = p0;
+			*q = q0;
+		}
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula el mejor divisor INC/MOD para un baudrate sin modificar ninguna uart
+ * @param br		Baudrate solicitado
+ * @param result	Divisor elegido, baudrate conseguido y error
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_compute_baudrate (uint32_t br, uart_baudrate_t *result)
+{
+	uint32_t oversampling, inc = 0, mod = 1;
+
+	if (result == 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	/*
+	 * El divisor fraccionario genera oversampling * br a partir de CPU_FREQ,
+	 * por lo que inc / mod = br * oversampling / CPU_FREQ, con inc < mod.
+	 * Preferimos 16 muestras por bit y pasamos a 8 sólo si no es posible
+	 */
+	for (oversampling = 16; oversampling >= 8; oversampling >>= 1){
+		if (br == 0 || (uint64_t) br * oversampling >= CPU_FREQ)
+			continue;
+
+		uart_best_ratio(br * oversampling, CPU_FREQ, 0xffff, &inc, &mod);
+
+		/* Muy cerca de 1 la mejor fracción puede ser 1/1, que no es válida */
+		if (inc == mod){
+			inc = 0xfffe;
+			mod = 0xffff;
+		}
+
+		if (inc > 0)
+			break;
+	}
+
+	if (oversampling < 8){
+		errno = EINVAL;
+		return -1;
+	}
+
+	result->inc = inc;
+	result->mod = mod;
+	result->oversampling = oversampling;
+	result->baudrate = ((uint64_t) (CPU_FREQ / oversampling) * inc + (mod >> 1)) / mod;
+	result->error_ppm = (int32_t) (((int64_t) result->baudrate - br) * 1000000 / br);
+
+	if (result->error_ppm > __UART_MAX_BAUD_ERROR__ || result->error_ppm < -__UART_MAX_BAUD_ERROR__){
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Calcula la duración de un silencio de chars caracteres en ciclos del
+ * temporizador de silencio, para el baudrate actual de la uart
+ * @param uart	Identificador de la uart
+ * @param chars	Número de caracteres
+ */
+static uint16_t uart_rx_timeout_ticks (uart_id_t uart, uint32_t chars)
+{
+	/* Cada carácter ocupa 10 bits: inicio, 8 de datos y parada */
+	uint32_t ticks = uart_baudrates[uart] ?
+		chars * 10 * (CPU_FREQ >> 7) / uart_baudrates[uart] : 0xffff;
+
+	if (ticks == 0)
+		ticks = 1;
+	else if (ticks > 0xffff)
+		ticks = 0xffff;
+
+	return ticks;
+}
+
+/*****************************************************************************/
+
+/**
+ * Convierte microsegundos en ciclos de BSP_TICK_TIMER, saturando a 32 bits
+ * @param us	Microsegundos
+ */
+static inline uint32_t uart_us_to_ticks (uint32_t us)
+{
+	if (us > 0xffffffff / (CPU_FREQ / 1000000))
+		return 0xffffffff;
+
+	return us * (CPU_FREQ / 1000000);
+}
+
+/*****************************************************************************/
+
+/**
+ * Acumula en elapsed los ciclos de BSP_TICK_TIMER transcurridos desde last.
+ * El temporizador da la vuelta cada 65536 ciclos, así que hay que llamarla
+ * con más frecuencia
+ * @param last		Última lectura del temporizador
+ * @param elapsed	Ciclos acumulados
+ */
+static inline void uart_tick_elapsed (uint16_t *last, uint32_t *elapsed)
+{
+	uint16_t now = tmr_read(BSP_TICK_TIMER);
+
+	*elapsed += (uint16_t) (now - *last);
+	*last = now;
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa una uart con búferes de tamaño por defecto
+ * @param uart	Identificador de la uart
+ * @param br	Baudrate, o UART_AUTOBAUD para arrancar a UART_AUTOBAUD_DEFAULT
+ * @param name	Nombre del dispositivo
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
+{
+	return uart_init_ex(uart, br, name, 0);
+}
+
+/*****************************************************************************/
+
+/**
+ * Inicializa una uart
+ * Los tamaños de los búferes deben ser potencias de dos. Si no lo son se usa
+ * la mayor potencia de dos que quepa. Un tamaño cero selecciona el tamaño por
+ * defecto. Un búfer nulo del tamaño por defecto usa memoria estática del
+ * driver, y uno nulo de otro tamaño se reserva con malloc y se libera al
+ * volver a inicializar la uart
+ * Con UART_AUTOBAUD la uart arranca a UART_AUTOBAUD_DEFAULT sin detectar
+ * nada. Para detectar el baudrate la aplicación debe llamar después a
+ * uart_autobaud
+ * @param uart	Identificador de la uart
+ * @param br	Baudrate, o UART_AUTOBAUD para arrancar a UART_AUTOBAUD_DEFAULT
+ * @param name	Nombre del dispositivo
+ * @param cfg	Configuración de los búferes. Puede ser NULL para usar la
+ * 				configuración por defecto
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t uart_init_ex (uart_id_t uart, uint32_t br, const char *name, const uart_config_t *cfg)
+{
+	/* ESTA FUNCIÓN SE DEFINIRÁ EN LAS PRÁCTICAS 8, 9 y 10 */
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (name == 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (br == UART_AUTOBAUD)
+		br = UART_AUTOBAUD_DEFAULT;
+
+	uart_baudrate_t baud;
+	if (uart_compute_baudrate(br, &baud) < 0)
+		return -1;
+
+	uint8_t *rx_buffer = cfg ? cfg->rx_buffer : 0;
+	uint8_t *tx_buffer = cfg ? cfg->tx_buffer : 0;
+	uint32_t rx_size = cfg && cfg->rx_size ? cfg->rx_size : __UART_BUFFER_SIZE__;
+	uint32_t tx_size = cfg && cfg->tx_size ? cfg->tx_size : __UART_BUFFER_SIZE__;
+
+	uint8_t *rx_heap = 0, *tx_heap = 0;
+
+	if (rx_buffer == 0 && rx_size == __UART_BUFFER_SIZE__)
+		rx_buffer = uart_rx_memory[uart];
+	else if (rx_buffer == 0 && (rx_buffer = rx_heap = malloc(rx_size)) == 0){
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (tx_buffer == 0 && tx_size == __UART_BUFFER_SIZE__)
+		tx_buffer = uart_tx_memory[uart];
+	else if (tx_buffer == 0 && (tx_buffer = tx_heap = malloc(tx_size)) == 0){
+		free(rx_heap);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* Una inicialización anterior puede haber dejado la isr activa */
+	itc_disable_interrupt(itc_src_uart1 + uart);
+
+	uart_regs[uart]->UCON = (1 << 13) | (1 << 14);
+	uart_regs[uart]->TxE = 0;
+	uart_regs[uart]->RxE = 0;
+
+	uart_regs[uart]->xTIM = baud.oversampling == 8;
+	uart_regs[uart]->BR = ( baud.inc << 16 ) | baud.mod;
+
+	uart_regs[uart]->UCON |= (1 << 0) | (1 << 1);
+	
+	gpio_set_pin_func(uart_pins[uart].tx, gpio_func_alternate_1);
+	gpio_set_pin_func(uart_pins[uart].rx, gpio_func_alternate_1);
+	gpio_set_pin_func(uart_pins[uart].cts, gpio_func_alternate_1);
+	gpio_set_pin_func(uart_pins[uart].rts, gpio_func_alternate_1);
+
+	gpio_set_pin_dir_output(uart_pins[uart].tx);
+	gpio_set_pin_dir_output(uart_pins[uart].cts);
+	gpio_set_pin_dir_input(uart_pins[uart].rx);
+	gpio_set_pin_dir_input(uart_pins[uart].rts);
+
+	circular_buffer_init(&uart_circular_rx_buffers[uart], rx_buffer, rx_size);
+	circular_buffer_init(&uart_circular_tx_buffers[uart], tx_buffer, tx_size);
+
+	/* Los búferes que reservó una inicialización anterior ya no se usan */
+	free(uart_rx_heap[uart]);
+	free(uart_tx_heap[uart]);
+	uart_rx_heap[uart] = rx_heap;
+	uart_tx_heap[uart] = tx_heap;
+
+	uart_baudrates[uart] = br;
+
+	uart_regs[uart]->TxLevel = 31;
+
+	itc_set_priority(itc_src_uart1 + uart, itc_priority_normal);
+	itc_set_handler_ctx(itc_src_uart1 + uart, uart_irq_handler, (void *) (uintptr_t) uart);
+	itc_enable_interrupt(itc_src_uart1 + uart);
+
+	uart_set_flow_control(uart, uart_flow_none);
+	uart_set_rx_threshold(uart, 0);
+
+	uart_callbacks[uart].rx_callback = 0;
+	uart_callbacks[uart].tx_callback = 0;
+	uart_callbacks[uart].mode = uart_callback_isr;
+	uart_callbacks[uart].rx_pending = 0;
+	uart_callbacks[uart].tx_pending = 0;
+
+	uart_tx_queues[uart].head = 0;
+	uart_tx_queues[uart].tail = 0;
+
+	uart_reset_stats(uart);
+	uart_frames[uart].pool = 0;
+
+	uart_regs[uart]->mRxR = 0;
+
+	bsp_register_dev(name, uart, 0, 0, uart_receive, uart_send, 0, uart_fstat, 0);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Reactiva la recepción si la isr la detuvo por falta de espacio y el
+ * programa principal ya ha liberado suficiente
+ * @param uart	Identificador de la uart
+ */
+static inline void uart_rx_resume (uart_id_t uart)
+{
+	uint32_t count = circular_buffer_count(&uart_circular_rx_buffers[uart]);
+
+	if (uart_regs[uart]->mRxR && (uart_flows[uart].mode != uart_flow_rtscts ||
+		count <= uart_flows[uart].low))
+			uart_regs[uart]->mRxR = 0;
+
+	/* Pedimos a la isr que envíe XON si habíamos detenido al otro extremo */
+	if (uart_flows[uart].rx_stopped && count <= uart_flows[uart].low){
+		uart_flows[uart].tx_ctrl = __UART_XON__;
+		uart_flows[uart].rx_stopped = 0;
+		uart_regs[uart]->mTxR = 0;
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Cambia el baudrate de una uart en funcionamiento
+ * Los bytes que se estén transmitiendo o recibiendo en ese momento se pierden,
+ * así que conviene llamarla con la línea en reposo
+ * @param uart		Identificador de la uart
+ * @param br		Baudrate
+ * @param result	Si no es NULL, divisor elegido, baudrate conseguido y error
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_baudrate (uart_id_t uart, uint32_t br, uart_baudrate_t *result)
+{
+	uart_baudrate_t baud;
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	if (uart_compute_baudrate(br, &baud) < 0)
+		return -1;
+
+	/* El divisor sólo puede cambiarse con el transmisor y el receptor parados */
+	uart_regs[uart]->TxE = 0;
+	uart_regs[uart]->RxE = 0;
+
+	uart_regs[uart]->xTIM = baud.oversampling == 8;
+	uart_regs[uart]->BR = ( baud.inc << 16 ) | baud.mod;
+
+	uart_regs[uart]->TxE = 1;
+	uart_regs[uart]->RxE = 1;
+
+	/* El temporizador de silencio depende del baudrate */
+	itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+	uart_baudrates[uart] = br;
+	uart_rx_thresholds[uart].ticks = uart_rx_timeout_ticks(uart, uart_rx_thresholds[uart].timeout_chars);
+	uart_frames[uart].ticks = uart_rx_timeout_ticks(uart, uart_frames[uart].gap);
+	itc_exit_critical(t);
+
+	if (result)
+		*result = baud;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Mide un carácter de sincronización muestreando el pin de recepción
+ * Entre el flanco de bajada del bit de inicio y el de subida del bit de
+ * parada de 0x55 hay nueve flancos y nueve bits
+ * @param uart		Identificador de la uart
+ * @param limit		Ciclos acumulados a partir de los que se abandona
+ * @param last		Última lectura del temporizador
+ * @param elapsed	Ciclos acumulados
+ * @return	El baudrate estimado o cero si se agota el tiempo
+ */
+static uint32_t uart_autobaud_measure (uart_id_t uart, uint32_t limit, uint16_t *last, uint32_t *elapsed)
+{
+	uint32_t level, prev, edges = 0, first = 0, span = 0;
+
+	gpio_set_pin_func(uart_pins[uart].rx, gpio_func_normal);
+	gpio_get_pin(uart_pins[uart].rx, &prev);
+
+	while (edges < 10 && *elapsed < limit){
+		gpio_get_pin(uart_pins[uart].rx, &level);
+		uart_tick_elapsed(last, elapsed);
+
+		if (level == prev)
+			continue;
+		prev = level;
+
+		/* Empezamos a contar en un flanco de bajada */
+		if (edges == 0 && level)
+			continue;
+
+		if (edges++ == 0)
+			first = *elapsed;
+		else
+			span = *elapsed - first;
+	}
+
+	gpio_set_pin_func(uart_pins[uart].rx, gpio_func_alternate_1);
+
+	if (edges < 10)
+		return 0;
+
+	return span ? (uint64_t) CPU_FREQ * 9 / span : uart_autobaud_rates[__UART_AUTOBAUD_RATES__ - 1];
+}
+
+/*****************************************************************************/
+
+/**
+ * Programa un baudrate y comprueba que se reciben con él dos caracteres de
+ * sincronización consecutivos sin errores de trama ni de paridad
+ * @param uart		Identificador de la uart
+ * @param br		Baudrate a probar
+ * @param limit		Ciclos acumulados a partir de los que se abandona
+ * @param last		Última lectura del temporizador
+ * @param elapsed	Ciclos acumulados
+ * @param result	Divisor programado
+ * @return	1 si el baudrate es correcto o 0 en otro caso
+ */
+static uint32_t uart_autobaud_probe (uart_id_t uart, uint32_t br, uint32_t limit,
+	uint16_t *last, uint32_t *elapsed, uart_baudrate_t *result)
+{
+	uint32_t status, good = 0;
+	uint32_t probe_end = *elapsed + __UART_AUTOBAUD_PROBE__ * (CPU_FREQ / 1000);
+	uint8_t c;
+
+	if (uart_set_baudrate(uart, br, result) < 0)
+		return 0;
+
+	/* Descartamos lo recibido con el baudrate anterior */
+	while (uart_regs[uart]->Rx_fifo_addr_diff > 0)
+		c = uart_regs[uart]->Rx_data;
+	status = uart_regs[uart]->USTAT;
+
+	while (good < 2 && *elapsed < probe_end && *elapsed < limit){
+		uart_tick_elapsed(last, elapsed);
+
+		if (uart_regs[uart]->Rx_fifo_addr_diff > 0){
+			status = uart_regs[uart]->USTAT;
+			c = uart_regs[uart]->Rx_data;
+
+			/* Un carácter erróneo puede ser el que cortamos al cambiar el baudrate */
+			if (c == __UART_AUTOBAUD_SYNC__ && !(status & ((1 << 1) | (1 << 2))))
+				good++;
+			else
+				good = 0;
+		}
+	}
+
+	return good == 2;
+}
+
+/*****************************************************************************/
+
+/**
+ * Detecta el baudrate del otro extremo y lo programa en la uart
+ * El otro extremo debe enviar repetidamente el carácter de sincronización 'U'
+ * (0x55), cuyos bits alternan entre 0 y 1. Se mide el carácter muestreando
+ * el pin de recepción con el temporizador BSP_TICK_TIMER y se confirma la
+ * estimación recibiendo dos caracteres 'U' correctos con la propia uart,
+ * probando los baudrates estándar del más cercano al más lejano
+ * Es bloqueante y deshabilita la recepción por interrupciones mientras dura
+ * @param uart		Identificador de la uart
+ * @param timeout	Tiempo máximo de espera en milisegundos
+ * @param result	Si no es NULL, divisor elegido, baudrate conseguido y error
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_autobaud (uart_id_t uart, uint32_t timeout, uart_baudrate_t *result)
+{
+	uart_baudrate_t baud;
+	uint32_t prev_mask, prev_br, estimate, tried, best, dist, found = 0, i, k;
+	uint32_t elapsed = 0, limit;
+	uint16_t last;
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	/* El límite se cuenta en ciclos de 32 bits */
+	if (timeout > 0xffffffff / (CPU_FREQ / 1000))
+		timeout = 0xffffffff / (CPU_FREQ / 1000);
+	limit = timeout * (CPU_FREQ / 1000);
+
+	/* La isr no debe consumir los caracteres de sincronización */
+	prev_mask = uart_regs[uart]->mRxR;
+	prev_br = uart_baudrates[uart];
+	uart_regs[uart]->mRxR = 1;
+
+	last = tmr_read(BSP_TICK_TIMER);
+
+	while (!found && (estimate = uart_autobaud_measure(uart, limit, &last, &elapsed)) != 0){
+		/*
+		 * Muestreando por software la estimación pierde precisión con la
+		 * velocidad, así que probamos los baudrates estándar empezando por el
+		 * más cercano. Cada bit de tried marca un baudrate ya probado
+		 */
+		for (tried = 0, k = 0; !found && k < __UART_AUTOBAUD_RATES__ && elapsed < limit; k++){
+			best = 0;
+			dist = 0xffffffff;
+			for (i = 0; i < __UART_AUTOBAUD_RATES__; i++){
+				if (tried & (1 << i))
+					continue;
+
+				if ((uart_autobaud_rates[i] > estimate ? uart_autobaud_rates[i] - estimate :
+					estimate - uart_autobaud_rates[i]) < dist){
+						dist = uart_autobaud_rates[i] > estimate ? uart_autobaud_rates[i] - estimate :
+							estimate - uart_autobaud_rates[i];
+						best = i;
+				}
+			}
+
+			tried |= 1 << best;
+			found = uart_autobaud_probe(uart, uart_autobaud_rates[best], limit, &last, &elapsed, &baud);
+		}
+	}
+
+	if (!found)
+		uart_set_baudrate(uart, prev_br, 0);
+
+	/* Descartamos los caracteres de sincronización que queden en la FIFO */
+	while (uart_regs[uart]->Rx_fifo_addr_diff > 0)
+		i = uart_regs[uart]->Rx_data;
+
+	uart_regs[uart]->mRxR = prev_mask;
+
+	if (!found){
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	if (result)
+		*result = baud;
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Transmite un byte por la uart
+ * Implementación del driver de nivel 0. La llamada se bloquea hasta que transmite el byte
+ * @param uart	Identificador de la uart
+ * @param c		El carácter
+ */
+void uart_send_byte (uart_id_t uart, uint8_t c)
+{
+	uint32_t prev_status = uart_regs[uart]->mTxR;
+	uart_regs[uart]->mTxR = 1;
+	uint32_t buffer_c = circular_buffer_read(&uart_circular_tx_buffers[uart]);
+
+	while (buffer_c != -1){
+		while(uart_regs[uart]->Tx_fifo_addr_diff == 0);
+		uart_regs[uart]->Tx_data = buffer_c;
+		uart_stats[uart].bytes_out++;
+		buffer_c = circular_buffer_read(&uart_circular_tx_buffers[uart]);
+	}
+
+	while(uart_regs[uart]->Tx_fifo_addr_diff == 0);
+	uart_regs[uart]->Tx_data = c;
+	uart_stats[uart].bytes_out++;
+
+	uart_regs[uart]->mTxR = prev_status;
+}
+
+
+/*****************************************************************************/
+
+/**
+ * Recibe un byte por la uart
+ * Implementación del driver de nivel 0. La llamada se bloquea hasta que recibe el byte
+ * @param uart	Identificador de la uart
+ * @return		El byte recibido
+ */
+uint8_t uart_receive_byte (uart_id_t uart)
+{
+	uint8_t read_byte = 0;
+
+	/* Leer del búfer no requiere enmascarar la isr: somos el único consumidor */
+	if (!circular_buffer_is_empty(&uart_circular_rx_buffers[uart])){
+		read_byte = circular_buffer_read(&uart_circular_rx_buffers[uart]);
+		uart_rx_resume(uart);
+	}
+
+	else{
+		/* Para leer directamente de la FIFO sí hay que apartar a la isr */
+		uint32_t prev_status = uart_regs[uart]->mRxR;
+		uart_regs[uart]->mRxR = 1;
+
+		while(uart_regs[uart]->Rx_fifo_addr_diff == 0);
+		read_byte = uart_regs[uart]->Rx_data;
+		uart_stats[uart].bytes_in++;
+
+		uart_regs[uart]->mRxR = prev_status;
+	}
+
+	return read_byte;
+}
+
+/*****************************************************************************/
+
+/**
+ * Intenta transmitir un byte por la uart sin esperar
+ * Implementación del driver de nivel 0. Si no hay nada pendiente de enviar el
+ * byte se escribe directamente en la FIFO; si no, se añade al búfer de
+ * transmisión detrás de lo pendiente para conservar el orden
+ * @param uart	Identificador de la uart
+ * @param c		El carácter
+ * @return	El carácter en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(EAGAIN si no hay sitio ni en la FIFO ni en el búfer)
+ */
+int32_t uart_try_send_byte (uart_id_t uart, uint8_t c)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	/*
+	 * Somos el único productor, así que si el búfer y la cola están vacíos
+	 * la isr sólo puede escribir en la FIFO un carácter de control. Lo
+	 * impedimos mientras comprobamos el hueco y escribimos el byte
+	 */
+	if (circular_buffer_is_empty(&uart_circular_tx_buffers[uart]) && uart_tx_queues[uart].head == 0){
+		itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+
+		if (!uart_flows[uart].tx_paused && uart_regs[uart]->Tx_fifo_addr_diff > 0){
+			uart_regs[uart]->Tx_data = c;
+			uart_stats[uart].bytes_out++;
+			itc_exit_critical(t);
+			return c;
+		}
+
+		itc_exit_critical(t);
+	}
+
+	if (circular_buffer_write(&uart_circular_tx_buffers[uart], c) == -1){
+		errno = EAGAIN;
+		return -1;
+	}
+
+	/* La isr enmascara la transmisión al vaciar el búfer. La reactivamos */
+	uart_regs[uart]->mTxR = 0;
+	return c;
+}
+
+/*****************************************************************************/
+
+/**
+ * Transmite un byte por la uart esperando como mucho timeout microsegundos
+ * Implementación del driver de nivel 0, con la misma semántica que
+ * uart_try_send_byte
+ * @param uart		Identificador de la uart
+ * @param c			El carácter
+ * @param timeout	Tiempo máximo de espera en microsegundos
+ * @return	El carácter en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(ETIMEDOUT si vence el plazo)
+ */
+int32_t uart_send_byte_timeout (uart_id_t uart, uint8_t c, uint32_t timeout)
+{
+	uint32_t elapsed = 0, limit;
+	uint16_t last;
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	limit = uart_us_to_ticks(timeout);
+	last = tmr_read(BSP_TICK_TIMER);
+
+	while (uart_try_send_byte(uart, c) == -1){
+		uart_tick_elapsed(&last, &elapsed);
+		if (elapsed >= limit){
+			errno = ETIMEDOUT;
+			return -1;
+		}
+	}
+
+	return c;
+}
+
+/*****************************************************************************/
+
+/**
+ * Espera máxima de uart_send_byte_urgent, en caracteres: el que se está
+ * transmitiendo y uno más de margen
+ */
+#define __UART_URGENT_CHARS__	2
+
+/**
+ * Transmite un byte por la uart adelantándolo a lo pendiente en el búfer de
+ * transmisión, que no se vacía ni se modifica
+ * Implementación del driver de nivel 0 para mensajes de error graves. Ignora
+ * el XOFF del otro extremo y espera hueco en la FIFO como mucho el tiempo de
+ * __UART_URGENT_CHARS__ caracteres, ya que con CTS desactivado la FIFO podría
+ * no vaciarse nunca
+ * @param uart	Identificador de la uart
+ * @param c		El carácter
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(ETIMEDOUT si la FIFO no tiene hueco a tiempo)
+ */
+int32_t uart_send_byte_urgent (uart_id_t uart, uint8_t c)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	/* Cada carácter ocupa 10 bits: inicio, 8 de datos y parada */
+	uint32_t limit = uart_baudrates[uart] ?
+		__UART_URGENT_CHARS__ * 10 * CPU_FREQ / uart_baudrates[uart] : 0;
+	uint32_t elapsed = 0;
+	uint16_t last;
+
+	/* La isr no debe escribir en la FIFO mientras esperamos hueco */
+	itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+
+	last = tmr_read(BSP_TICK_TIMER);
+	while (uart_regs[uart]->Tx_fifo_addr_diff == 0){
+		uart_tick_elapsed(&last, &elapsed);
+		if (elapsed >= limit){
+			itc_exit_critical(t);
+			errno = ETIMEDOUT;
+			return -1;
+		}
+	}
+
+	uart_regs[uart]->Tx_data = c;
+	uart_stats[uart].bytes_out++;
+
+	itc_exit_critical(t);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Intenta recibir un byte por la uart sin esperar
+ * Implementación del driver de nivel 0. Lee del búfer de recepción o, si está
+ * vacío, de la FIFO, donde puede haber bytes por debajo del umbral
+ * @param uart	Identificador de la uart
+ * @return	El byte como un casting de uint8_t a int32_t en caso de éxito o
+ * 		-1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(EAGAIN si no hay ningún byte)
+ */
+int32_t uart_try_receive_byte (uart_id_t uart)
+{
+	int32_t c;
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	/* Leer del búfer no requiere enmascarar la isr: somos el único consumidor */
+	if ((c = circular_buffer_read(&uart_circular_rx_buffers[uart])) != -1){
+		uart_rx_resume(uart);
+		return c;
+	}
+
+	/* Para leer directamente de la FIFO sí hay que apartar a la isr */
+	if (!uart_frames[uart].pool){
+		itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+		if (uart_regs[uart]->Rx_fifo_addr_diff > 0){
+			c = uart_regs[uart]->Rx_data;
+			uart_stats[uart].bytes_in++;
+		}
+		itc_exit_critical(t);
+	}
+
+	if (c == -1)
+		errno = EAGAIN;
+
+	return c;
+}
+
+/*****************************************************************************/
+
+/**
+ * Recibe un byte por la uart esperando como mucho timeout microsegundos
+ * Implementación del driver de nivel 0, con la misma semántica que
+ * uart_try_receive_byte
+ * @param uart		Identificador de la uart
+ * @param timeout	Tiempo máximo de espera en microsegundos
+ * @return	El byte como un casting de uint8_t a int32_t en caso de éxito o
+ * 		-1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(ETIMEDOUT si vence el plazo)
+ */
+int32_t uart_receive_byte_timeout (uart_id_t uart, uint32_t timeout)
+{
+	uint32_t elapsed = 0, limit;
+	uint16_t last;
+	int32_t c;
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	limit = uart_us_to_ticks(timeout);
+	last = tmr_read(BSP_TICK_TIMER);
+
+	while ((c = uart_try_receive_byte(uart)) == -1){
+		uart_tick_elapsed(&last, &elapsed);
+		if (elapsed >= limit){
+			errno = ETIMEDOUT;
+			return -1;
+		}
+	}
+
+	return c;
+}
+
+/*****************************************************************************/
+
+/**
+ * Transmisión de bytes
+ * Implementación del driver de nivel 1. La llamada es no bloqueante y se realiza mediante interrupciones
+ * @param uart	Identificador de la uart
+ * @param buf	Búfer con los caracteres
+ * @param count	Número de caracteres a escribir
+ * @return	El número de bytes almacenados en el búfer de transmisión en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_send (uint32_t uart, char *buf, size_t count)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (buf == 0 || count <= 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	/*
+	 * El programa principal es el único productor del búfer de transmisión y
+	 * la isr su único consumidor, por lo que no hace falta enmascarar la
+	 * interrupción mientras escribimos
+	 */
+	uint32_t i = circular_buffer_write_span(&uart_circular_tx_buffers[uart],
+		(const uint8_t *) buf, count);
+
+	/* La isr enmascara la transmisión al vaciar el búfer. La reactivamos */
+	if (i > 0)
+		uart_regs[uart]->mTxR = 0;
+
+	return i;
+}
+
+/*****************************************************************************/
+
+/**
+ * Recepción de bytes
+ * Implementación del driver de nivel 1. La llamada es no bloqueante y se realiza mediante interrupciones
+ * @param uart	Identificador de la uart
+ * @param buf	Búfer para almacenar los bytes
+ * @param count	Número de bytes a leer
+ * @return	El número de bytes realmente leídos en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_receive (uint32_t uart, char *buf, size_t count)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (buf == 0 || count <= 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	/*
+	 * La isr es el único productor del búfer de recepción y el programa
+	 * principal su único consumidor, por lo que no hace falta enmascarar la
+	 * interrupción mientras leemos
+	 */
+	uint32_t i = circular_buffer_read_span(&uart_circular_rx_buffers[uart],
+		(uint8_t *) buf, count);
+
+	/* Si la isr enmascaró la recepción por tener el búfer lleno, la reactivamos */
+	if (i > 0)
+		uart_rx_resume(uart);
+
+	return i;
+}
+
+/*****************************************************************************/
+
+/**
+ * Transmisión asíncrona sin copias
+ * Encola un descriptor con un búfer del llamador. La isr vuelca los datos
+ * directamente desde ese búfer a la FIFO, sin pasar por el búfer circular de
+ * transmisión y sin límite de tamaño. Los bytes escritos con uart_send tienen
+ * prioridad sobre los descriptores encolados. No se admite en modo FIQ
+ * @param uart	Identificador de la uart
+ * @param desc	Descriptor de la transmisión. Debe permanecer válido hasta que
+ * 		se invoque su función done
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_send_async (uart_id_t uart, uart_tx_desc_t *desc)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (desc == 0 || desc->buf == 0 || desc->len == 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	/* En modo FIQ la función done se ejecutaría en modo FIQ */
+	else if (uart_fiq.uart == uart){
+		errno = EINVAL;
+		return -1;
+	}
+
+	desc->next = 0;
+	desc->sent = 0;
+
+	/*
+	 * La isr también modifica la cola, incluso cuando atiende una recepción,
+	 * así que deshabilitamos la fuente de la uart mientras enlazamos
+	 */
+	itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+
+	if (uart_tx_queues[uart].tail)
+		uart_tx_queues[uart].tail->next = desc;
+	else
+		uart_tx_queues[uart].head = desc;
+	uart_tx_queues[uart].tail = desc;
+
+	uart_regs[uart]->mTxR = 0;
+	itc_exit_critical(t);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Descarta la transmisión pendiente de una uart: vacía el búfer de
+ * transmisión y retira de la cola todos los descriptores, sin invocar sus
+ * funciones done. Los bytes que ya estén en la FIFO sí se transmiten
+ * @param uart	Identificador de la uart
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_cancel_tx (uart_id_t uart)
+{
+	volatile circular_buffer_t *cb;
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	cb = &uart_circular_tx_buffers[uart];
+
+	/* Con la isr apartada podemos hacer de consumidor del búfer y de la cola */
+	itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+
+	circular_buffer_consume(cb, circular_buffer_count(cb));
+	uart_tx_queues[uart].head = 0;
+	uart_tx_queues[uart].tail = 0;
+
+	itc_exit_critical(t);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Fija la función callback de recepción de una uart
+ * No se admite en modo FIQ
+ * @param uart	Identificador de la uart
+ * @param func	Función callback. NULL para anular una selección anterior
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (func && uart_fiq.uart == uart){
+		errno = EINVAL;
+		return -1;
+	}
+
+	uart_callbacks[uart].rx_callback = func;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Fija la función callback de transmisión de una uart
+ * No se admite en modo FIQ
+ * @param uart	Identificador de la uart
+ * @param func	Función callback. NULL para anular una selección anterior
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (func && uart_fiq.uart == uart){
+		errno = EINVAL;
+		return -1;
+	}
+
+	uart_callbacks[uart].tx_callback = func;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Selecciona el contexto en el que se ejecutan las callbacks de una uart
+ * En modo diferido la isr sólo anota que hay trabajo pendiente y las
+ * callbacks se ejecutan cuando el programa principal llama a
+ * uart_dispatch_callbacks, una vez por ráfaga aunque haya habido varias
+ * interrupciones. Así el tiempo en la isr está acotado y las callbacks
+ * pueden usar la E/S estándar
+ * @param uart	Identificador de la uart
+ * @param mode	Contexto de ejecución de las callbacks
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_callback_mode (uart_id_t uart, uart_callback_mode_t mode)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (mode >= uart_callback_max){
+		errno = EINVAL;
+		return -1;
+	}
+
+	uart_callbacks[uart].mode = mode;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta las callbacks diferidas pendientes de todas las uart
+ * Debe llamarse periódicamente desde el bucle del programa principal
+ * @return	El número de callbacks ejecutadas
+ */
+uint32_t uart_dispatch_callbacks (void)
+{
+	uart_id_t uart;
+	uart_callback_t func;
+	uint32_t dispatched = 0;
+
+	for (uart = uart_1; uart < uart_max; uart++){
+		/* Borramos la marca antes de consultar el búfer para no perder avisos */
+		if (uart_callbacks[uart].rx_pending){
+			uart_callbacks[uart].rx_pending = 0;
+			if ((func = uart_callbacks[uart].rx_callback) != 0){
+				func(uart, uart_frames[uart].pool ?
+					uart_frames[uart].closed - uart_frames[uart].released :
+					circular_buffer_count(&uart_circular_rx_buffers[uart]));
+				dispatched++;
+			}
+		}
+
+		if (uart_callbacks[uart].tx_pending){
+			uart_callbacks[uart].tx_pending = 0;
+			if ((func = uart_callbacks[uart].tx_callback) != 0){
+				func(uart, uart_circular_tx_buffers[uart].size -
+					circular_buffer_count(&uart_circular_tx_buffers[uart]));
+				dispatched++;
+			}
+		}
+	}
+
+	return dispatched;
+}
+
+/*****************************************************************************/
+
+/**
+ * Selecciona qué ocurre cuando se llena el búfer de transmisión de una uart
+ * En modo circular_buffer_mode_overwrite uart_send nunca se queda corta: se
+ * descartan los bytes más antiguos pendientes de enviar, lo que permite que
+ * las trazas y la consola sigan avanzando conservando lo más reciente.
+ * Los bytes descartados se contabilizan en el campo lost de las estadísticas
+ * @param uart	Identificador de la uart
+ * @param mode	Comportamiento del búfer cuando se llena
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_tx_mode (uart_id_t uart, circular_buffer_mode_t mode)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (mode >= circular_buffer_mode_max){
+		errno = EINVAL;
+		return -1;
+	}
+
+	circular_buffer_set_mode(&uart_circular_tx_buffers[uart], mode);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Configura el umbral adaptativo de interrupción de recepción de una uart
+ * Usa el temporizador asignado a la uart en system.h para detectar el
+ * silencio en la línea
+ * @param uart	Identificador de la uart
+ * @param thr	Configuración del umbral. NULL fija el umbral a un byte y
+ * 		deshabilita la adaptación
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_rx_threshold (uart_id_t uart, const uart_rx_threshold_t *thr)
+{
+	static const uart_rx_threshold_t fixed = {1, 1, 0};
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	if (thr == 0)
+		thr = &fixed;
+
+	if (thr->min_level < 1 || thr->max_level > 31 || thr->min_level > thr->max_level ||
+		(thr->max_level > thr->min_level && (thr->timeout == 0 || uart_fiq.uart == uart))){
+			errno = EINVAL;
+			return -1;
+	}
+
+	/* La isr también usa este estado */
+	itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+	tmr_stop(uart_rx_timers[uart]);
+
+	uart_rx_thresholds[uart].min_level = thr->min_level;
+	uart_rx_thresholds[uart].max_level = thr->max_level;
+	uart_rx_thresholds[uart].level = thr->min_level;
+	uart_rx_thresholds[uart].timeout = 0;
+	uart_rx_thresholds[uart].timeout_chars = thr->timeout;
+	uart_rx_thresholds[uart].ticks = uart_rx_timeout_ticks(uart, thr->timeout);
+
+	/* El control de flujo puede limitar el umbral */
+	if (uart_rx_thresholds[uart].level > uart_flows[uart].max_level)
+		uart_rx_thresholds[uart].level = uart_flows[uart].max_level;
+	if (!uart_frames[uart].pool)
+		uart_regs[uart]->RxLevel = uart_rx_thresholds[uart].level;
+
+	itc_unforce_interrupt(itc_src_uart1 + uart);
+	itc_exit_critical(t);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Selecciona el control de flujo de una uart
+ * Con control de flujo la recepción se detiene cuando el búfer de recepción
+ * llega a 3/4 de su capacidad y se reanuda cuando baja de 1/4.
+ * Con uart_flow_rtscts, mientras está detenida los bytes se acumulan en la
+ * FIFO y el hardware desactiva CTS para que el otro extremo deje de transmitir.
+ * Con uart_flow_xonxoff se envía XOFF y XON al otro extremo y, a su vez, la
+ * transmisión se detiene al recibir XOFF y se reanuda al recibir XON. Estos
+ * dos caracteres se retiran de los datos recibidos, por lo que este modo sólo
+ * es válido para texto
+ * @param uart	Identificador de la uart
+ * @param flow	Modo de control de flujo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_flow_control (uart_id_t uart, uart_flow_t flow)
+{
+	uint32_t size;
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (flow >= uart_flow_max || (flow == uart_flow_xonxoff &&
+		(uart_frames[uart].pool || uart_fiq.uart == uart))){
+		errno = EINVAL;
+		return -1;
+	}
+
+	size = uart_circular_rx_buffers[uart].size;
+
+	/* La isr también usa este estado */
+	itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+
+	uart_flows[uart].mode = flow;
+	uart_flows[uart].high = size - (size >> 2);
+	uart_flows[uart].low = size >> 2;
+	uart_flows[uart].tx_ctrl = 0;
+	uart_flows[uart].tx_paused = 0;
+	uart_flows[uart].rx_stopped = 0;
+
+	if (flow == uart_flow_rtscts){
+		/*
+		 * Por encima de __UART_CTS_LEVEL__ el otro extremo deja de transmitir,
+		 * así que el umbral de recepción tiene que quedar por debajo
+		 */
+		uart_flows[uart].max_level = __UART_CTS_LEVEL__ - 1;
+		uart_regs[uart]->UCTS = __UART_CTS_LEVEL__;
+		uart_regs[uart]->FCp = 0;
+		uart_regs[uart]->FCe = 1;
+	}
+	else{
+		uart_flows[uart].max_level = 31;
+		uart_regs[uart]->FCe = 0;
+	}
+
+	if (uart_rx_thresholds[uart].level > uart_flows[uart].max_level){
+		uart_rx_thresholds[uart].level = uart_flows[uart].max_level;
+		if (!uart_frames[uart].pool)
+			uart_regs[uart]->RxLevel = uart_flows[uart].max_level;
+	}
+
+	/* Si la transmisión estaba detenida por un XOFF, la reanudamos */
+	if (!circular_buffer_is_empty(&uart_circular_tx_buffers[uart]) || uart_tx_queues[uart].head)
+		uart_regs[uart]->mTxR = 0;
+
+	itc_exit_critical(t);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Activa o desactiva el bucle interno de una uart (bit TST de UCON)
+ * Con el bucle activo lo transmitido se recibe en la propia uart sin pasar
+ * por los pines, lo que permite probar el driver sin hardware adicional
+ * @param uart		Identificador de la uart
+ * @param enable	Distinto de cero para activar el bucle
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_loopback (uart_id_t uart, uint32_t enable)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	uart_regs[uart]->TST = enable != 0;
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Activa o desactiva el modo FIQ de una uart
+ * En este modo la interrupción de la uart es rápida y un manejador en
+ * ensamblador vacía la FIFO de recepción en el búfer sin guardar ningún
+ * contexto, con los punteros del búfer en los registros propios del modo FIQ.
+ * La transmisión y los errores se siguen atendiendo desde la isr en C.
+ * Sólo una uart puede estar en modo FIQ, y el modo no es compatible con la
+ * recepción por tramas, uart_flow_xonxoff, el umbral adaptativo ni la callback
+ * de recepción, porque el manejador rápido no los atiende. Tampoco admite la
+ * callback de transmisión ni descriptores de uart_send_async, ya que el
+ * código del usuario se ejecutaría en modo FIQ. Las interrupciones
+ * que resuelve el manejador rápido no se contabilizan en interrupts ni en las
+ * estadísticas del búfer de recepción.
+ * Esta función sólo funciona en modos privilegiados
+ * @param uart		Identificador de la uart
+ * @param enable	Distinto de cero para activar el modo FIQ
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_fiq_mode (uart_id_t uart, uint32_t enable)
+{
+	volatile circular_buffer_t *cb;
+	uint32_t regs[5];
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (enable && uart_fiq.uart != uart_max && uart_fiq.uart != uart){
+		errno = EBUSY;
+		return -1;
+	}
+
+	else if (enable && (uart_frames[uart].pool || uart_flows[uart].mode == uart_flow_xonxoff ||
+		uart_rx_thresholds[uart].max_level > uart_rx_thresholds[uart].min_level ||
+		uart_callbacks[uart].rx_callback || uart_callbacks[uart].tx_callback ||
+		uart_tx_queues[uart].head)){
+			errno = EINVAL;
+			return -1;
+	}
+
+	cb = &uart_circular_rx_buffers[uart];
+
+	/* La isr también usa este estado */
+	itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+
+	if (enable && uart_fiq.uart == uart_max){
+		regs[0] = (uint32_t) uart_regs[uart];
+		regs[1] = (uint32_t) cb;
+		regs[2] = (uint32_t) (cb->data + (cb->end & cb->mask));
+		regs[3] = (uint32_t) (cb->data + cb->size);
+		regs[4] = 0;
+		excep_set_fiq_regs(regs);
+
+		uart_fiq.end = cb->end;
+		uart_fiq.uart = uart;
+		excep_set_handler(excep_fiq, uart_fiq_handler);
+		itc_set_priority(itc_src_uart1 + uart, itc_priority_fast);
+	}
+
+	else if (!enable && uart_fiq.uart == uart){
+		itc_set_priority(itc_src_uart1 + uart, itc_priority_normal);
+		excep_set_handler(excep_fiq, excep_fiq_handler);
+		uart_fiq.uart = uart_max;
+		uart_stats[uart].bytes_in += cb->end - uart_fiq.end;
+	}
+
+	itc_exit_critical(t);
+	return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Activa o desactiva la recepción por tramas de una uart
+ * En este modo los bytes recibidos no pasan por el búfer de recepción: se
+ * agrupan en tramas que se obtienen con uart_get_frame, y la callback de
+ * recepción se invoca una vez por trama. La FIFO interrumpe con cada byte y
+ * el temporizador de silencio de la uart, rearmado en cada interrupción,
+ * delimita las tramas. Si no quedan tramas libres la recepción se detiene
+ * hasta que se libere alguna. No es compatible con uart_flow_xonxoff ni con
+ * el modo FIQ
+ * @param uart	Identificador de la uart
+ * @param cfg	Configuración de las tramas. NULL vuelve al modo normal
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_frame_mode (uart_id_t uart, const uart_frame_config_t *cfg)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
+
+	else if (cfg != 0 && cfg->buffer == 0){
+		errno = EFAULT;
+		return -1;
+	}
+
+	else if (cfg != 0 && (cfg->frame_size == 0 || cfg->frames < 2 ||
+		cfg->frames > UART_MAX_FRAMES || cfg->gap == 0 || cfg->gap > 255 ||
+		uart_flows[uart].mode == uart_flow_xonxoff || uart_fiq.uart == uart)){
+			errno = EINVAL;
+			return -1;
+	}
+
+	/* La isr también usa este estado */
+	itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+	tmr_stop(uart_rx_timers[uart]);
+	uart_rx_thresholds[uart].timeout = 0;
+	itc_unforce_interrupt(itc_src_uart1 + uart);
+
+	if (cfg == 0){
+		uart_frames[uart].pool = 0;
+		uart_regs[uart]->RxLevel = uart_rx_thresholds[uart].level;
+	}
+
+	else{
+		/*
+		 * El temporizador se rearma en cada interrupción. Con un umbral
+		 * mayor que 1 habría que sumarle los bytes que faltan para la
+		 * siguiente y tramas separadas por menos silencio se fundirían, así
+		 * que interrumpimos con cada byte y el temporizador mide sólo el
+		 * silencio entre tramas
+		 */
+		uart_frames[uart].size = cfg->frame_size;
+		uart_frames[uart].frames = cfg->frames;
+		uart_frames[uart].len = 0;
+		uart_frames[uart].closed = 0;
+		uart_frames[uart].released = 0;
+		uart_frames[uart].gap = cfg->gap;
+		uart_frames[uart].ticks = uart_rx_timeout_ticks(uart, cfg->gap);
+		uart_frames[uart].pool = cfg->buffer;
+		uart_regs[uart]->RxLevel = 1;
+	}
+
+	uart_regs[uart]->mRxR = 0;
+
+	itc_exit_critical(t);
+	return 0;
+}
 
 /*****************************************************************************/
 
 /**
- * Tamaño de los búferes circulares
+ * Obtiene la trama recibida más antigua de una uart sin retirarla
+ * @param uart	Identificador de la uart
+ * @param frame	Estructura donde se devuelven los datos y la longitud
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(EAGAIN si no hay ninguna trama completa)
  */
-#define __UART_BUFFER_SIZE__	256
+int32_t uart_get_frame (uart_id_t uart, uart_frame_t *frame)
+{
+	uint32_t n;
+
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
 
-static volatile uint8_t uart_rx_buffers[uart_max][__UART_BUFFER_SIZE__];
-static volatile uint8_t uart_tx_buffers[uart_max][__UART_BUFFER_SIZE__];
+	else if (frame == 0){
+		errno = EFAULT;
+		return -1;
+	}
 
-static volatile circular_buffer_t uart_circular_rx_buffers[uart_max];
-static volatile circular_buffer_t uart_circular_tx_buffers[uart_max];
+	else if (uart_frames[uart].pool == 0){
+		errno = EINVAL;
+		return -1;
+	}
+
+	else if (uart_frames[uart].closed == uart_frames[uart].released){
+		errno = EAGAIN;
+		return -1;
+	}
 
+	n = uart_frames[uart].released % uart_frames[uart].frames;
+	frame->data = uart_frames[uart].pool + n * uart_frames[uart].size;
+	frame->len = uart_frames[uart].lengths[n];
+	return 0;
+}
 
 /*****************************************************************************/
 
 /**
- * Gestión de las callbacks
+ * Libera la trama más antigua de una uart, devolviendo su espacio a la isr
+ * @param uart	Identificador de la uart
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
  */
-typedef struct
+int32_t uart_release_frame (uart_id_t uart)
 {
-	uart_callback_t tx_callback;
-	uart_callback_t rx_callback;
-} uart_callbacks_t;
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
 
-static volatile uart_callbacks_t uart_callbacks[uart_max];
+	else if (uart_frames[uart].pool == 0 ||
+		uart_frames[uart].closed == uart_frames[uart].released){
+			errno = EINVAL;
+			return -1;
+	}
+
+	uart_frames[uart].released++;
+
+	/* Si la isr detuvo la recepción por falta de tramas libres, la reactivamos */
+	if (uart_regs[uart]->mRxR)
+		uart_regs[uart]->mRxR = 0;
+
+	return 0;
+}
 
 /*****************************************************************************/
 
 /**
- * Inicializa una uart
+ * Retorna el espacio libre en el búfer de transmisión de una uart
  * @param uart	Identificador de la uart
- * @param br	Baudrate
- * @param name	Nombre del dispositivo
- * @return		Cero en caso de éxito o -1 en caso de error.
- * 				La condición de error se indica en la variable global errno
+ * @return	El número de bytes libres en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
  */
-int32_t uart_init (uart_id_t uart, uint32_t br, const char *name)
+int32_t uart_get_tx_space (uart_id_t uart)
 {
-	/* ESTA FUNCIÓN SE DEFINIRÁ EN LAS PRÁCTICAS 8, 9 y 10 */
 	if (uart >= uart_max){
 		errno = ENODEV;
 		return -1;
 	}
 
-	else if (name == 0){
-		errno = EFAULT;
-		return -1;
-	}
-
-	uint32_t mod = 9999;
-	uint32_t inc = br * mod / (CPU_FREQ >> 4);
-	
-	uart_regs[uart]->UCON = (1 << 13) | (1 << 14);
-	uart_regs[uart]->TxE = 0;
-	uart_regs[uart]->RxE = 0;
-	
-	uart_regs[uart]->BR = ( inc << 16 ) | mod;
-
-	uart_regs[uart]->UCON |= (1 << 0) | (1 << 1);
-	
-	gpio_set_pin_func(uart_pins[uart].tx, gpio_func_alternate_1);
-	gpio_set_pin_func(uart_pins[uart].rx, gpio_func_alternate_1);
-	gpio_set_pin_func(uart_pins[uart].cts, gpio_func_alternate_1);
-	gpio_set_pin_func(uart_pins[uart].rts, gpio_func_alternate_1);
+	return uart_circular_tx_buffers[uart].size -
+		circular_buffer_count(&uart_circular_tx_buffers[uart]);
+}
 
-	gpio_set_pin_dir_output(uart_pins[uart].tx);
-	gpio_set_pin_dir_output(uart_pins[uart].cts);
-	gpio_set_pin_dir_input(uart_pins[uart].rx);
-	gpio_set_pin_dir_input(uart_pins[uart].rts);
+/*****************************************************************************/
 
-	circular_buffer_init(&uart_circular_rx_buffers[uart], (uint8_t *) uart_rx_buffers,
-		sizeof(uart_rx_buffers[uart]));
+/**
+ * Retorna las estadísticas de los búferes de una uart
+ * @param uart	Identificador de la uart
+ * @param rx	Estadísticas del búfer de recepción. Puede ser NULL
+ * @param tx	Estadísticas del búfer de transmisión. Puede ser NULL
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_get_buffer_stats (uart_id_t uart, circular_buffer_stats_t *rx, circular_buffer_stats_t *tx)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
 
-	circular_buffer_init(&uart_circular_tx_buffers[uart], (uint8_t *) uart_tx_buffers,
-		sizeof(uart_tx_buffers[uart]));
+	if (rx)
+		circular_buffer_get_stats(&uart_circular_rx_buffers[uart], rx);
 
-	uart_regs[uart]->RxLevel = 1;
-	uart_regs[uart]->TxLevel = 31;
+	if (tx)
+		circular_buffer_get_stats(&uart_circular_tx_buffers[uart], tx);
 
-	itc_set_priority(itc_src_uart1 + uart, itc_priority_normal);
-	itc_set_handler(itc_src_uart1 + uart, uart_irq_handlers[uart]);
-	itc_enable_interrupt(itc_src_uart1 + uart);
+	return 0;
+}
 
-	uart_callbacks[uart].rx_callback = 0;
-	uart_callbacks[uart].tx_callback = 0;
+/*****************************************************************************/
 
-	uart_regs[uart]->mRxR = 0;
+/**
+ * Reinicia las estadísticas de los búferes de una uart
+ * @param uart	Identificador de la uart
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_reset_buffer_stats (uart_id_t uart)
+{
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
+	}
 
-	bsp_register_dev(name, uart, 0, 0, uart_receive, uart_send, 0, 0, 0);
+	circular_buffer_reset_stats(&uart_circular_rx_buffers[uart]);
+	circular_buffer_reset_stats(&uart_circular_tx_buffers[uart]);
 	return 0;
 }
 
 /*****************************************************************************/
 
 /**
- * Transmite un byte por la uart
- * Implementación del driver de nivel 0. La llamada se bloquea hasta que transmite el byte
+ * Retorna los contadores de errores y actividad de una uart
  * @param uart	Identificador de la uart
- * @param c		El carácter
+ * @param stats	Estructura donde se copian los contadores
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
  */
-void uart_send_byte (uart_id_t uart, uint8_t c)
+int32_t uart_get_stats (uart_id_t uart, uart_stats_t *stats)
 {
-	uint32_t prev_status = uart_regs[uart]->mTxR;
-	uart_regs[uart]->mTxR = 1;
-	uint32_t buffer_c = circular_buffer_read(&uart_circular_tx_buffers[uart]);
-
-	while (buffer_c != -1){
-		while(uart_regs[uart]->Tx_fifo_addr_diff == 0);
-		uart_regs[uart]->Tx_data = buffer_c;
-		buffer_c = circular_buffer_read(&uart_circular_tx_buffers[uart]);
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
 	}
 
-	while(uart_regs[uart]->Tx_fifo_addr_diff == 0);
-	uart_regs[uart]->Tx_data = c;
+	else if (stats == 0){
+		errno = EFAULT;
+		return -1;
+	}
 
-	uart_regs[uart]->mTxR = prev_status;
+	stats->framing_errors = uart_stats[uart].framing_errors;
+	stats->parity_errors = uart_stats[uart].parity_errors;
+	stats->start_errors = uart_stats[uart].start_errors;
+	stats->rx_overruns = uart_stats[uart].rx_overruns;
+	stats->rx_underruns = uart_stats[uart].rx_underruns;
+	stats->tx_overruns = uart_stats[uart].tx_overruns;
+	stats->bytes_in = uart_stats[uart].bytes_in;
+	if (uart_fiq.uart == uart)
+		stats->bytes_in += uart_circular_rx_buffers[uart].end - uart_fiq.end;
+	stats->bytes_out = uart_stats[uart].bytes_out;
+	stats->interrupts = uart_stats[uart].interrupts;
+	stats->frame_errors = uart_stats[uart].frame_errors;
+	return 0;
 }
 
-
 /*****************************************************************************/
 
 /**
- * Recibe un byte por la uart
- * Implementación del driver de nivel 0. La llamada se bloquea hasta que recibe el byte
+ * Reinicia los contadores de errores y actividad de una uart
  * @param uart	Identificador de la uart
- * @return		El byte recibido
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
  */
-uint8_t uart_receive_byte (uart_id_t uart)
+int32_t uart_reset_stats (uart_id_t uart)
 {
-	uint32_t prev_status = uart_regs[uart]->mRxR;
-	uart_regs[uart]->mRxR = 1;
-	uint8_t read_byte = 0;
-
-	if (!circular_buffer_is_empty(&uart_circular_rx_buffers[uart]))
-		read_byte = circular_buffer_read(&uart_circular_rx_buffers[uart]);
-
-	else{
-		while(uart_regs[uart]->Rx_fifo_addr_diff == 0);
-		read_byte = uart_regs[uart]->Rx_data;
+	if (uart >= uart_max){
+		errno = ENODEV;
+		return -1;
 	}
 
-	uart_regs[uart]->mRxR = prev_status;
-	return read_byte;
+	/* La isr también actualiza los contadores */
+	itc_token_t t = itc_enter_critical_sources(ITC_SRC(itc_src_uart1 + uart));
+
+	uart_stats[uart].framing_errors = 0;
+	uart_stats[uart].parity_errors = 0;
+	uart_stats[uart].start_errors = 0;
+	uart_stats[uart].rx_overruns = 0;
+	uart_stats[uart].rx_underruns = 0;
+	uart_stats[uart].tx_overruns = 0;
+	uart_stats[uart].bytes_in = 0;
+	uart_stats[uart].bytes_out = 0;
+	uart_stats[uart].interrupts = 0;
+	uart_stats[uart].frame_errors = 0;
+	if (uart_fiq.uart == uart)
+		uart_fiq.end = uart_circular_rx_buffers[uart].end;
+
+	itc_exit_critical(t);
+	return 0;
 }
 
 /*****************************************************************************/
 
 /**
- * Transmisión de bytes
- * Implementación del driver de nivel 1. La llamada es no bloqueante y se realiza mediante interrupciones
+ * Función fstat del dispositivo
+ * Además de indicar que es un dispositivo de caracteres, st_size es el número
+ * de bytes que se pueden leer sin esperar, st_blksize el tamaño del búfer de
+ * recepción y st_blocks el total de errores de línea (FE, PE, SE y ROE)
  * @param uart	Identificador de la uart
- * @param buf	Búfer con los caracteres
- * @param count	Número de caracteres a escribir
- * @return	El número de bytes almacenados en el búfer de transmisión en caso de éxito o
- *              -1 en caso de error.
+ * @param buf	Estructura stat a rellenar
+ * @return	Cero en caso de éxito o -1 en caso de error.
  * 		La condición de error se indica en la variable global errno
  */
-ssize_t uart_send (uint32_t uart, char *buf, size_t count)
+int uart_fstat (uint32_t uart, struct stat *buf)
 {
 	if (uart >= uart_max){
 		errno = ENODEV;
 		return -1;
 	}
 
-	else if (buf == 0 || count <= 0){
+	else if (buf == 0){
 		errno = EFAULT;
 		return -1;
 	}
 
-	uint32_t prev_status = uart_regs[uart]->mTxR;
-	uart_regs[uart]->mTxR = 1;
+	memset(buf, 0, sizeof(struct stat));
+	buf->st_mode = S_IFCHR;
+	buf->st_rdev = uart;
+	buf->st_size = circular_buffer_count(&uart_circular_rx_buffers[uart]);
+	buf->st_blksize = uart_circular_rx_buffers[uart].size;
+	buf->st_blocks = uart_stats[uart].framing_errors + uart_stats[uart].parity_errors +
+		uart_stats[uart].start_errors + uart_stats[uart].rx_overruns;
+	return 0;
+}
+
+/*****************************************************************************/
 
-	uint32_t i = 0;
-	while(!circular_buffer_is_full(&uart_circular_tx_buffers[uart]) && count > 0){
-		circular_buffer_write(&uart_circular_tx_buffers[uart], buf[i]);
-		i++;
-		count--;
+/**
+ * Actualiza un CRC-16-CCITT (polinomio 0x1021) con un byte
+ * @param crc	CRC acumulado
+ * @param c		Byte
+ */
+static inline uint16_t uart_slip_crc (uint16_t crc, uint8_t c)
+{
+	crc = (uint8_t) (crc >> 8) | (crc << 8);
+	crc ^= c;
+	crc ^= (uint8_t) (crc & 0xff) >> 4;
+	crc ^= crc << 12;
+	crc ^= (crc & 0xff) << 5;
+	return crc;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe un byte escapado en la región libre del búfer de transmisión sin
+ * publicarlo
+ * @param cb	Búfer de transmisión
+ * @param n		Posición relativa a la de escritura
+ * @param c		Byte
+ * @return	La posición siguiente
+ */
+static inline uint32_t uart_slip_stage (volatile circular_buffer_t *cb, uint32_t n, uint8_t c)
+{
+	if (c == __UART_SLIP_END__){
+		circular_buffer_stage(cb, n++, __UART_SLIP_ESC__);
+		c = __UART_SLIP_ESC_END__;
+	}
+	else if (c == __UART_SLIP_ESC__){
+		circular_buffer_stage(cb, n++, __UART_SLIP_ESC__);
+		c = __UART_SLIP_ESC_ESC__;
 	}
 
-	if (i > 0)
-		uart_regs[uart]->mTxR = 0;
-	else
-		uart_regs[uart]->mTxR = prev_status;
-		
-	return i;
+	circular_buffer_stage(cb, n++, c);
+	return n;
 }
 
 /*****************************************************************************/
 
 /**
- * Recepción de bytes
- * Implementación del driver de nivel 1. La llamada es no bloqueante y se realiza mediante interrupciones
+ * Transmisión de una trama SLIP (RFC 1055) con CRC-16-CCITT
+ * Añade el CRC, escapa los datos y escribe la trama completa directamente en
+ * el búfer de transmisión, así que la isr nunca ve una trama a medias. Como
+ * uart_send, no es bloqueante: si la trama no cabe entera no se escribe nada
  * @param uart	Identificador de la uart
- * @param buf	Búfer para almacenar los bytes
- * @param count	Número de bytes a leer
- * @return	El número de bytes realmente leídos en caso de éxito o
- *              -1 en caso de error.
+ * @param buf	Datos de la trama
+ * @param count	Número de bytes de la trama
+ * @return	El número de bytes de la trama en caso de éxito o -1 en caso de error.
  * 		La condición de error se indica en la variable global errno
+ * 		(EAGAIN si ahora no hay sitio para la trama)
  */
-ssize_t uart_receive (uint32_t uart, char *buf, size_t count)
+ssize_t uart_slip_send (uint32_t uart, char *buf, size_t count)
 {
+	volatile circular_buffer_t *cb;
+	uint16_t crc = __UART_SLIP_CRC_INIT__;
+	uint32_t len, i, n;
+	uint8_t c;
+
 	if (uart >= uart_max){
 		errno = ENODEV;
 		return -1;
@@ -328,126 +2062,498 @@ ssize_t uart_receive (uint32_t uart, char *buf, size_t count)
 		return -1;
 	}
 
-	uint32_t prev_status = uart_regs[uart]->mRxR;
-	uart_regs[uart]->mRxR = 1;
+	cb = &uart_circular_tx_buffers[uart];
 
-	uint32_t i = 0;
-	while(!circular_buffer_is_empty(&uart_circular_rx_buffers[uart]) && count > 0){
-		buf[i] = circular_buffer_read(&uart_circular_rx_buffers[uart]);
-		i++;
-		count--;
+	/* Calculamos el CRC y la longitud de la trama codificada */
+	for (i = 0, len = 2; i < count; i++){
+		c = buf[i];
+		crc = uart_slip_crc(crc, c);
+		len += (c == __UART_SLIP_END__ || c == __UART_SLIP_ESC__) ? 2 : 1;
 	}
-	
-	uart_regs[uart]->mRxR = prev_status;
-	return i;
+
+	c = crc >> 8;
+	len += (c == __UART_SLIP_END__ || c == __UART_SLIP_ESC__) ? 2 : 1;
+	c = crc & 0xff;
+	len += (c == __UART_SLIP_END__ || c == __UART_SLIP_ESC__) ? 2 : 1;
+
+	if (len > cb->size){
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	/*
+	 * Con el otro extremo detenido (XOFF o CTS) el espacio podría no liberarse
+	 * nunca, así que no esperamos. La isr es el único consumidor y el espacio
+	 * libre sólo puede crecer, así que basta con comprobarlo una vez
+	 */
+	if (cb->size - circular_buffer_count(cb) < len){
+		errno = EAGAIN;
+		return -1;
+	}
+
+	/* Un END inicial descarta el ruido que haya podido recibir el otro extremo */
+	n = 0;
+	circular_buffer_stage(cb, n++, __UART_SLIP_END__);
+	for (i = 0; i < count; i++)
+		n = uart_slip_stage(cb, n, buf[i]);
+	n = uart_slip_stage(cb, n, crc >> 8);
+	n = uart_slip_stage(cb, n, crc & 0xff);
+	circular_buffer_stage(cb, n++, __UART_SLIP_END__);
+
+	circular_buffer_commit(cb, n);
+
+	/* La isr enmascara la transmisión al vaciar el búfer. La reactivamos */
+	uart_regs[uart]->mTxR = 0;
+
+	return count;
 }
 
 /*****************************************************************************/
 
 /**
- * Fija la función callback de recepción de una uart
+ * Recepción de una trama SLIP (RFC 1055) con CRC-16-CCITT
+ * Decodifica directamente desde el búfer de recepción la siguiente trama
+ * completa. Las tramas con un CRC o un escape incorrecto, o que no caben en
+ * buf, se descartan y se contabilizan en las estadísticas de la uart.
+ * La llamada es no bloqueante
  * @param uart	Identificador de la uart
- * @param func	Función callback. NULL para anular una selección anterior
- * @return	Cero en caso de éxito o -1 en caso de error.
+ * @param buf	Búfer para almacenar la trama
+ * @param count	Tamaño del búfer
+ * @return	El número de bytes de la trama, cero si no hay ninguna completa o
+ * 		-1 en caso de error.
  * 		La condición de error se indica en la variable global errno
  */
-int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func)
+ssize_t uart_slip_receive (uint32_t uart, char *buf, size_t count)
 {
+	volatile circular_buffer_t *cb;
+	uint32_t avail, end, i, n, esc, error;
+	uint16_t crc;
+	int32_t c;
+
 	if (uart >= uart_max){
 		errno = ENODEV;
 		return -1;
 	}
 
-	else if (func == 0){
+	else if (buf == 0 || count <= 0){
 		errno = EFAULT;
 		return -1;
 	}
 
-	uart_callbacks[uart].rx_callback = func;
-	return 0;
+	cb = &uart_circular_rx_buffers[uart];
+
+	for (;;){
+		/* Buscamos el final de la trama a partir de donde lo dejamos */
+		avail = circular_buffer_count(cb);
+		for (end = uart_slip_scanned[uart]; end < avail; end++)
+			if (circular_buffer_peek(cb, end) == __UART_SLIP_END__)
+				break;
+
+		if (end == avail){
+			if (avail < cb->size){
+				uart_slip_scanned[uart] = end;
+				return 0;
+			}
+
+			/* La trama no cabe en el búfer de recepción. La descartamos */
+			circular_buffer_consume(cb, avail);
+			uart_slip_scanned[uart] = 0;
+			uart_stats[uart].frame_errors++;
+			uart_rx_resume(uart);
+			continue;
+		}
+
+		/* Decodificamos directamente del búfer de recepción al del llamador */
+		for (i = 0, n = 0, esc = 0, error = 0, crc = __UART_SLIP_CRC_INIT__; i < end; i++){
+			c = circular_buffer_peek(cb, i);
+			if (esc){
+				if (c == __UART_SLIP_ESC_END__)
+					c = __UART_SLIP_END__;
+				else if (c == __UART_SLIP_ESC_ESC__)
+					c = __UART_SLIP_ESC__;
+				else
+					error = 1;
+				esc = 0;
+			}
+			else if (c == __UART_SLIP_ESC__){
+				esc = 1;
+				continue;
+			}
+
+			crc = uart_slip_crc(crc, c);
+			if (n < count)
+				buf[n] = c;
+			n++;
+		}
+
+		circular_buffer_consume(cb, end + 1);
+		uart_slip_scanned[uart] = 0;
+		uart_rx_resume(uart);
+
+		/* Los END consecutivos sólo separan tramas */
+		if (n == 0)
+			continue;
+
+		if (error || esc || n < 3 || crc != 0 || n - 2 > count){
+			uart_stats[uart].frame_errors++;
+			continue;
+		}
+
+		return n - 2;
+	}
 }
 
 /*****************************************************************************/
 
 /**
- * Fija la función callback de transmisión de una uart
+ * Registra un dispositivo que transmite y recibe tramas SLIP con CRC sobre
+ * una uart ya inicializada. Comparte los búferes con el dispositivo de la
+ * uart, por lo que no deben usarse a la vez
  * @param uart	Identificador de la uart
- * @param func	Función callback. NULL para anular una selección anterior
- * @return	Cero en caso de éxito o -1 en caso de error.
+ * @param name	Nombre del dispositivo
+ * @return	El número de dispositivo asignado o -1 en caso de error.
  * 		La condición de error se indica en la variable global errno
  */
-int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func)
+int32_t uart_slip_register (uart_id_t uart, const char *name)
 {
 	if (uart >= uart_max){
 		errno = ENODEV;
 		return -1;
 	}
 
-	else if (func == 0){
+	else if (name == 0){
 		errno = EFAULT;
 		return -1;
 	}
 
-	uart_callbacks[uart].tx_callback = func;
-	return 0;
+	uart_slip_scanned[uart] = 0;
+	return bsp_register_dev(name, uart, 0, 0, uart_slip_receive, uart_slip_send, 0, uart_fstat, 0);
 }
 
 /*****************************************************************************/
 
 /**
- * Manejador genérico de interrupciones para las uart.
- * Cada isr llamará a este manejador indicando la uart en la que se ha
- * producido la interrupción.
- * Lo declaramos inline para reducir la latencia de la isr
- * @param uart	Identificador de la uart
+ * Callback de los temporizadores de silencio en la recepción
+ * La línea lleva timeout caracteres sin actividad y en la FIFO puede haber
+ * menos bytes que el umbral. Forzamos la interrupción de la uart para que sea
+ * su isr la que vacíe la FIFO
+ * @param tmr	Temporizador que ha vencido
  */
-static inline void uart_isr (uart_id_t uart)
+static void uart_rx_timeout (tmr_id_t tmr)
 {
-	uint32_t status = uart_regs[uart]->USTAT;
+	uart_id_t uart;
+
+	for (uart = uart_1; uart < uart_max; uart++){
+		if (uart_rx_timers[uart] == tmr){
+			uart_rx_thresholds[uart].timeout = 1;
+			itc_force_interrupt(itc_src_uart1 + uart);
+		}
+	}
+}
 
-	if (uart_regs[uart]->RxRdy){
-		while(uart_regs[uart]->Rx_fifo_addr_diff > 0 && 
-			!circular_buffer_is_full(&uart_circular_rx_buffers[uart]))
-				circular_buffer_write(&uart_circular_rx_buffers[uart], uart_regs[uart]->Rx_data);
+/*****************************************************************************/
+
+/**
+ * Cierra la trama en recepción de una uart, si tiene algún byte, y avisa a la
+ * callback de recepción
+ * @param uart	Identificador de la uart
+ */
+static inline void uart_rx_frame_close (uart_id_t uart)
+{
+	if (uart_frames[uart].len == 0)
+		return;
+
+	uart_frames[uart].lengths[uart_frames[uart].closed % uart_frames[uart].frames] =
+		uart_frames[uart].len;
+	uart_frames[uart].len = 0;
+	uart_frames[uart].closed++;
+
+	if (uart_callbacks[uart].rx_callback){
+		if (uart_callbacks[uart].mode == uart_callback_deferred)
+			uart_callbacks[uart].rx_pending = 1;
+		else
+			uart_callbacks[uart].rx_callback(uart,
+				uart_frames[uart].closed - uart_frames[uart].released);
+	}
+}
 
-		if (uart_callbacks[uart].rx_callback)
-			uart_callbacks[uart].rx_callback();
+/*****************************************************************************/
 
-		if (circular_buffer_is_full(&uart_circular_rx_buffers[uart]))
+/**
+ * Recepción en modo de tramas
+ * Vacía la FIFO en la trama en recepción y la cierra cuando se llena o cuando
+ * vence el temporizador de silencio
+ * @param uart		Identificador de la uart
+ * @param timeout	La isr se ha forzado por silencio en la línea
+ */
+static inline void uart_rx_frame_isr (uart_id_t uart, uint32_t timeout)
+{
+	uint8_t *addr;
+	uint32_t len, pending, i;
+
+	while ((pending = uart_regs[uart]->Rx_fifo_addr_diff) > 0){
+		if (uart_frames[uart].closed - uart_frames[uart].released >= uart_frames[uart].frames){
+			/*
+			 * No quedan tramas libres. Los bytes esperan en la FIFO hasta que
+			 * se libere alguna (con RTS/CTS el otro extremo deja de transmitir)
+			 */
 			uart_regs[uart]->mRxR = 1;
+			break;
+		}
+
+		addr = uart_frames[uart].pool +
+			(uart_frames[uart].closed % uart_frames[uart].frames) * uart_frames[uart].size +
+			uart_frames[uart].len;
+		len = uart_frames[uart].size - uart_frames[uart].len;
+		if (len > pending)
+			len = pending;
+
+		for (i = 0; i < len; i++)
+			addr[i] = uart_regs[uart]->Rx_data;
+
+		uart_frames[uart].len += len;
+		uart_stats[uart].bytes_in += len;
+
+		if (uart_frames[uart].len == uart_frames[uart].size)
+			uart_rx_frame_close(uart);
 	}
 
-	if (uart_regs[uart]->TxRdy){
-		while(!circular_buffer_is_empty(&uart_circular_tx_buffers[uart]) &&
-			uart_regs[uart]->Tx_fifo_addr_diff > 0)
-				uart_regs[uart]->Tx_data = circular_buffer_read(&uart_circular_tx_buffers[uart]);
+	if (timeout)
+		uart_rx_frame_close(uart);
+	else
+		tmr_start_oneshot(uart_rx_timers[uart], __UART_RX_TIMER_DIV__,
+			uart_frames[uart].ticks, uart_rx_timeout);
+}
+
+/*****************************************************************************/
+
+/**
+ * Manejador genérico de interrupciones para las uart.
+ * Lo llaman uart_irq_handler y el camino lento del modo FIQ indicando la uart
+ * en la que se ha producido la interrupción.
+ * Lo declaramos inline para reducir la latencia de la isr
+ * @param uart		Identificador de la uart
+ * @param status	Valor del registro USTAT. Su lectura borra los errores
+ */
+static inline void uart_isr (uart_id_t uart, uint32_t status)
+{
+	uint8_t *addr, c;
+	uint32_t len, pending, i, j;
+	uart_tx_desc_t *desc;
+	uint32_t timeout = uart_rx_thresholds[uart].timeout;
+
+	/* Contabilizamos los errores. Se borran al leer USTAT */
+	uart_stats[uart].interrupts++;
+	if (status & __UART_USTAT_ERRORS__){
+		if (status & __UART_USTAT_FE__)
+			uart_stats[uart].framing_errors++;
+		if (status & __UART_USTAT_PE__)
+			uart_stats[uart].parity_errors++;
+		if (status & __UART_USTAT_SE__)
+			uart_stats[uart].start_errors++;
+		if (status & __UART_USTAT_ROE__)
+			uart_stats[uart].rx_overruns++;
+		if (status & __UART_USTAT_RUE__)
+			uart_stats[uart].rx_underruns++;
+		if (status & __UART_USTAT_TOE__)
+			uart_stats[uart].tx_overruns++;
+	}
 
-			if (uart_callbacks[uart].tx_callback)
-				uart_callbacks[uart].tx_callback();
+	if (timeout){
+		uart_rx_thresholds[uart].timeout = 0;
+		itc_unforce_interrupt(itc_src_uart1 + uart);
+	}
+
+	if (uart_frames[uart].pool && (uart_regs[uart]->RxRdy || timeout))
+		uart_rx_frame_isr(uart, timeout);
+
+	else if (uart_regs[uart]->RxRdy || timeout){
+		/* Volcamos la FIFO directamente en la región libre del búfer */
+		while((pending = uart_regs[uart]->Rx_fifo_addr_diff) > 0 &&
+			(len = circular_buffer_peek_contiguous(&uart_circular_rx_buffers[uart], &addr)) > 0){
+				if (len > pending)
+					len = pending;
+
+				if (uart_flows[uart].mode != uart_flow_xonxoff){
+					for (i = 0; i < len; i++)
+						addr[i] = uart_regs[uart]->Rx_data;
+					j = len;
+				}
+
+				else{
+					/* Retiramos XON/XOFF de los datos y paramos o reanudamos la transmisión */
+					for (i = 0, j = 0; i < len; i++){
+						c = uart_regs[uart]->Rx_data;
+						if (c == __UART_XOFF__)
+							uart_flows[uart].tx_paused = 1;
+						else if (c == __UART_XON__){
+							uart_flows[uart].tx_paused = 0;
+							uart_regs[uart]->mTxR = 0;
+						}
+						else
+							addr[j++] = c;
+					}
+				}
+
+				circular_buffer_commit(&uart_circular_rx_buffers[uart], j);
+				uart_stats[uart].bytes_in += len;
+		}
+
+		if (uart_callbacks[uart].rx_callback){
+			if (uart_callbacks[uart].mode == uart_callback_deferred)
+				uart_callbacks[uart].rx_pending = 1;
+			else
+				uart_callbacks[uart].rx_callback(uart,
+					circular_buffer_count(&uart_circular_rx_buffers[uart]));
+		}
+
+		if (uart_flows[uart].mode == uart_flow_rtscts){
+			/*
+			 * Con control de flujo hardware dejamos de vaciar la FIFO antes de
+			 * llenar el búfer. Los bytes esperan en la FIFO y el hardware detiene
+			 * al otro extremo, así que no se pierde nada
+			 */
+			if (circular_buffer_count(&uart_circular_rx_buffers[uart]) >= uart_flows[uart].high)
+				uart_regs[uart]->mRxR = 1;
+		}
+
+		else if (uart_flows[uart].mode == uart_flow_xonxoff && !uart_flows[uart].rx_stopped &&
+			circular_buffer_count(&uart_circular_rx_buffers[uart]) >= uart_flows[uart].high){
+				/* Con control de flujo software seguimos recibiendo mientras llega el XOFF */
+				uart_flows[uart].tx_ctrl = __UART_XOFF__;
+				uart_flows[uart].rx_stopped = 1;
+				uart_regs[uart]->mTxR = 0;
+		}
+
+		if (uart_flows[uart].mode != uart_flow_rtscts &&
+			circular_buffer_is_full(&uart_circular_rx_buffers[uart])){
+			/* Registramos los bytes que se quedan en la FIFO por falta de espacio */
+			circular_buffer_stats_overflow(&uart_circular_rx_buffers[uart],
+				uart_regs[uart]->Rx_fifo_addr_diff);
+			uart_regs[uart]->mRxR = 1;
+		}
+
+		/*
+		 * Umbral adaptativo: cada vez que se alcanza el umbral lo duplicamos y
+		 * rearmamos el temporizador de silencio. Cuando vence, la ráfaga ha
+		 * terminado y volvemos al umbral mínimo para no retrasar la consola
+		 */
+		if (uart_rx_thresholds[uart].max_level > uart_rx_thresholds[uart].min_level){
+			if (timeout)
+				len = uart_rx_thresholds[uart].min_level;
+			else{
+				len = uart_rx_thresholds[uart].level << 1;
+				if (len > uart_rx_thresholds[uart].max_level)
+					len = uart_rx_thresholds[uart].max_level;
+				if (len > uart_flows[uart].max_level)
+					len = uart_flows[uart].max_level;
+
+				tmr_start_oneshot(uart_rx_timers[uart], __UART_RX_TIMER_DIV__,
+					uart_rx_thresholds[uart].ticks, uart_rx_timeout);
+			}
+
+			if (len != uart_rx_thresholds[uart].level){
+				uart_rx_thresholds[uart].level = len;
+				uart_regs[uart]->RxLevel = len;
+			}
+		}
+	}
 
-			if (circular_buffer_is_empty(&uart_circular_tx_buffers[uart]))
-				uart_regs[uart]->mTxR = 1;
+	if (uart_regs[uart]->TxRdy){
+		/* Los caracteres de control de flujo se adelantan a los datos */
+		if (uart_flows[uart].tx_ctrl && uart_regs[uart]->Tx_fifo_addr_diff > 0){
+			uart_regs[uart]->Tx_data = uart_flows[uart].tx_ctrl;
+			uart_flows[uart].tx_ctrl = 0;
+			uart_stats[uart].bytes_out++;
+		}
+
+		/* Rellenamos la FIFO directamente desde la región de datos del búfer */
+		while(!uart_flows[uart].tx_paused &&
+			(pending = uart_regs[uart]->Tx_fifo_addr_diff) > 0 &&
+			(len = circular_buffer_peek_data(&uart_circular_tx_buffers[uart], &addr)) > 0){
+				if (len > pending)
+					len = pending;
+
+				for (i = 0; i < len; i++)
+					uart_regs[uart]->Tx_data = addr[i];
+
+				circular_buffer_consume(&uart_circular_tx_buffers[uart], len);
+				uart_stats[uart].bytes_out += len;
+		}
+
+		/* Después, directamente desde los búferes de los descriptores encolados */
+		while(!uart_flows[uart].tx_paused &&
+			(pending = uart_regs[uart]->Tx_fifo_addr_diff) > 0 &&
+			(desc = uart_tx_queues[uart].head) != 0){
+				len = desc->len - desc->sent;
+				if (len > pending)
+					len = pending;
+
+				for (i = 0; i < len; i++)
+					uart_regs[uart]->Tx_data = desc->buf[desc->sent + i];
+
+				desc->sent += len;
+				uart_stats[uart].bytes_out += len;
+				if (desc->sent == desc->len){
+					uart_tx_queues[uart].head = desc->next;
+					if (desc->next == 0)
+						uart_tx_queues[uart].tail = 0;
+
+					if (desc->done)
+						desc->done(desc);
+				}
+		}
+
+			if (uart_callbacks[uart].tx_callback){
+				if (uart_callbacks[uart].mode == uart_callback_deferred)
+					uart_callbacks[uart].tx_pending = 1;
+				else
+					uart_callbacks[uart].tx_callback(uart, uart_circular_tx_buffers[uart].size -
+						circular_buffer_count(&uart_circular_tx_buffers[uart]));
+			}
+
+			/* Con XOFF recibido enmascaramos hasta que llegue XON */
+			if (uart_flows[uart].tx_ctrl == 0 && (uart_flows[uart].tx_paused ||
+				(circular_buffer_is_empty(&uart_circular_tx_buffers[uart]) &&
+				uart_tx_queues[uart].head == 0)))
+					uart_regs[uart]->mTxR = 1;
 	}
 }
 
 /*****************************************************************************/
 
 /**
- * Manejador de interrupciones para la uart1
+ * Manejador de interrupciones de las uart
+ * @param ctx	Identificador de la uart que ha interrumpido
  */
-static void uart_1_isr (void)
+static void uart_irq_handler (void *ctx)
 {
-	uart_isr(uart_1);
+	uart_id_t uart = (uart_id_t) (uintptr_t) ctx;
+
+	uart_isr(uart, uart_regs[uart]->USTAT);
 }
 
 /*****************************************************************************/
 
 /**
- * Manejador de interrupciones para la uart2
+ * Camino lento del manejador rápido de la uart en modo FIQ
+ * uart_fiq_handler la llama, en modo FIQ, cuando hay algo más que hacer que
+ * vaciar la FIFO de recepción: errores, transmisión o el búfer de recepción
+ * lleno
+ * @param status	Valor de USTAT leído por el manejador rápido
+ * @return	Posición del búfer de recepción donde se escribirá el siguiente byte
  */
-static void uart_2_isr (void)
+uint8_t *uart_fiq_isr (uint32_t status)
 {
-	uart_isr(uart_2);
+	uart_id_t uart = uart_fiq.uart;
+	volatile circular_buffer_t *cb = &uart_circular_rx_buffers[uart];
+
+	/* La isr contabiliza los bytes que vacíe ella */
+	uart_stats[uart].bytes_in += cb->end - uart_fiq.end;
+	uart_isr(uart, status);
+	uart_fiq.end = cb->end;
+
+	return cb->data + (cb->end & cb->mask);
 }
 
 /*****************************************************************************/
@@ -0,0 +1,107 @@
+@
+@ Sistemas Empotrados
+@ Manejador rápido (FIQ) para la recepción de una uart
+@
+
+@
+@ Registros de la uart (uart_regs_t en uart.c)
+@
+	.set _UART_UCON, 0x00
+	.set _UART_USTAT, 0x04
+	.set _UART_UDATA, 0x08
+	.set _UART_URXCON, 0x0C
+
+	.set _UART_UCON_MTXR, 0x2000		@ Interrupción de transmisión enmascarada
+	.set _UART_USTAT_ERRORS, 0x3F		@ SE, PE, FE, TOE, ROE y RUE
+	.set _UART_USTAT_TXRDY, 0x80
+	.set _UART_URXCON_COUNT, 0x3F		@ Bytes en la FIFO de recepción
+
+@
+@ Campos del búfer circular (circular_buffer_t en circular_buffer.h)
+@
+	.set _CB_DATA, 0
+	.set _CB_SIZE, 4
+	.set _CB_START, 12
+	.set _CB_END, 16
+
+	.code 32
+	.text
+
+@
+@ Manejador de FIQ para la uart en modo FIQ
+@ Sólo usa los registros propios del modo FIQ, que uart_set_fiq_mode carga con:
+@	r8:	registros de la uart
+@	r9:	búfer circular de recepción
+@	r10:	posición del búfer donde se escribirá el siguiente byte
+@	r11:	final de la zona de datos del búfer
+@ r12 y sp quedan como registros de trabajo, así que el camino rápido no
+@ guarda ningún contexto. Si hay errores, transmisión pendiente o el búfer se
+@ llena, el camino lento reinicia la pila del modo FIQ y llama a uart_fiq_isr
+@
+	.align	4
+	.global	uart_fiq_handler
+	.type	uart_fiq_handler, %function
+uart_fiq_handler:
+	@ Leer USTAT borra los errores, así que se pasa su valor al camino lento
+	ldr	r12, [r8, #_UART_USTAT]
+	tst	r12, #_UART_USTAT_ERRORS
+	bne	uart_fiq_slow
+	tst	r12, #_UART_USTAT_TXRDY
+	beq	1f
+	ldr	sp, [r8, #_UART_UCON]
+	tst	sp, #_UART_UCON_MTXR
+	beq	uart_fiq_slow
+
+1:
+	@ r12: espacio libre en el búfer
+	ldr	r12, [r9, #_CB_END]
+	ldr	sp, [r9, #_CB_START]
+	sub	r12, r12, sp
+	ldr	sp, [r9, #_CB_SIZE]
+	sub	r12, sp, r12
+
+2:
+	ldr	sp, [r8, #_UART_URXCON]
+	tst	sp, #_UART_URXCON_COUNT
+	beq	3f
+
+	subs	r12, r12, #1
+	movmi	r12, #0
+	bmi	uart_fiq_slow
+
+	ldrb	sp, [r8, #_UART_UDATA]
+	strb	sp, [r10], #1
+	cmp	r10, r11
+	ldreq	r10, [r9, #_CB_DATA]
+
+	@ El dato ya está en el búfer, publicamos el nuevo índice
+	ldr	sp, [r9, #_CB_END]
+	add	sp, sp, #1
+	str	sp, [r9, #_CB_END]
+	b	2b
+
+3:
+	subs	pc, lr, #4
+
+@
+@ Camino lento: la isr en C atiende la uart y retorna la nueva posición de
+@ escritura, porque también puede vaciar la FIFO en el búfer. El AAPCS exige
+@ la pila alineada a 8 bytes, así que apilamos también r12 aunque esté en el
+@ banco del modo FIQ
+@
+uart_fiq_slow:
+	ldr	sp, =_fiq_stack_top
+	stmfd	sp!, {r0-r3, r12, lr}
+
+	mov	r0, r12
+	ldr	r1, =uart_fiq_isr
+	mov	lr, pc
+	bx	r1
+	mov	r10, r0
+
+	ldmfd	sp!, {r0-r3, r12, lr}
+	subs	pc, lr, #4
+
+	.size	uart_fiq_handler, .-uart_fiq_handler
+
+	.ltorg
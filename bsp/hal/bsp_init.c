@@ -23,15 +23,76 @@ static void bsp_excep_init( void )
 
 /*****************************************************************************/
 
+/**
+ * Memoria de los búferes de las UARTs. La uart1 es la consola y la uart2 se
+ * usa para transferencias masivas, así que se dimensionan por separado
+ */
+static uint8_t bsp_uart1_rx_buffer[UART1_RX_BUFFER_SIZE];
+static uint8_t bsp_uart1_tx_buffer[UART1_TX_BUFFER_SIZE];
+static uint8_t bsp_uart2_rx_buffer[UART2_RX_BUFFER_SIZE];
+static uint8_t bsp_uart2_tx_buffer[UART2_TX_BUFFER_SIZE];
+
+static const uart_config_t bsp_uart1_config = {
+		bsp_uart1_rx_buffer, UART1_RX_BUFFER_SIZE,
+		bsp_uart1_tx_buffer, UART1_TX_BUFFER_SIZE };
+
+static const uart_config_t bsp_uart2_config = {
+		bsp_uart2_rx_buffer, UART2_RX_BUFFER_SIZE,
+		bsp_uart2_tx_buffer, UART2_TX_BUFFER_SIZE };
+
+/**
+ * Umbrales adaptativos de recepción de las UARTs
+ */
+static const uart_rx_threshold_t bsp_uart1_rx_threshold = {
+		UART1_RX_LEVEL_MIN, UART1_RX_LEVEL_MAX, UART1_RX_TIMEOUT };
+
+static const uart_rx_threshold_t bsp_uart2_rx_threshold = {
+		UART2_RX_LEVEL_MIN, UART2_RX_LEVEL_MAX, UART2_RX_TIMEOUT };
+
+/*****************************************************************************/
+
+#if BSP_MUX
+/**
+ * Nombres de los dispositivos de los canales multiplexados
+ */
+static const char * const bsp_mux_names[mux_max] = {
+		MUX_CONSOLE_NAME, MUX_TRACE_NAME, MUX_DATA_NAME, MUX_CONTROL_NAME };
+#endif
+
+/*****************************************************************************/
+
 /**
  * Inicializa los dispositivos del sistema.
  * Esta función se debe llamar después de  bsp_int_init().
  */
 static void bsp_sys_init( void )
 {
+	/* Inicialización de los temporizadores */
+	tmr_init();
+	tmr_start_free_running(BSP_TICK_TIMER, tmr_div_1);
+#if ITC_PROFILING
+	tmr_start_free_running(BSP_PROFILE_TIMER, BSP_PROFILE_DIV);
+#endif
+
 	/* Inicialización de las UARTs */
-	uart_init(UART1_ID, UART1_BAUDRATE, UART1_NAME);
-	uart_init(UART2_ID, UART2_BAUDRATE, UART2_NAME);
+	uart_init_ex(UART1_ID, UART1_BAUDRATE, UART1_NAME, &bsp_uart1_config);
+	uart_init_ex(UART2_ID, UART2_BAUDRATE, UART2_NAME, &bsp_uart2_config);
+	uart_set_flow_control(UART1_ID, UART1_FLOW_CONTROL);
+	uart_set_flow_control(UART2_ID, UART2_FLOW_CONTROL);
+	uart_set_rx_threshold(UART1_ID, &bsp_uart1_rx_threshold);
+#if UART2_FIQ
+	uart_set_rx_threshold(UART2_ID, 0);
+	uart_set_fiq_mode(UART2_ID, 1);
+#else
+	uart_set_rx_threshold(UART2_ID, &bsp_uart2_rx_threshold);
+#endif
+	uart_slip_register(UART1_ID, UART1_SLIP_NAME);
+	uart_slip_register(UART2_ID, UART2_SLIP_NAME);
+
+#if BSP_MUX
+	/* Canales multiplexados */
+	mux_init(MUX_UART, bsp_mux_names);
+#endif
 }
 
 /*****************************************************************************/
@@ -19,7 +19,12 @@ extern volatile excep_handler_t _excep_handlers[excep_max];
  */
 void excep_init ()
 {
-	excep_set_handler (excep_irq, excep_nonnested_irq_handler);
+#if BSP_NESTED_IRQ
+	excep_set_handler (excep_irq, excep_nested_irq_handler);
+#else
+	excep_set_handler (excep_irq, excep_nonnested_irq_handler_asm);
+#endif
+	excep_set_handler (excep_fiq, excep_fiq_handler);
 }
 
 /*****************************************************************************/
@@ -210,3 +215,17 @@ void excep_nonnested_irq_handler ()
 }
 
 /*****************************************************************************/
+
+/**
+ * Manejador en C para las interrupciones rápidas
+ * Da servicio a la fuente rápida pendiente a través del ITC. Los drivers
+ * pueden sustituirlo por un manejador propio que mantenga su estado en los
+ * registros r8-r12 del modo FIQ
+ */
+__attribute__ ((interrupt ("FIQ")))
+void excep_fiq_handler ()
+{
+	itc_service_fast_interrupt();
+}
+
+/*****************************************************************************/
@@ -0,0 +1,35 @@
+@
+@ Sistemas Empotrados
+@ Acceso a los registros propios del modo FIQ
+@
+
+	.set _IRQ_DISABLE, 0x80 @ cuando el bit I está activo, IRQ está deshabilitado
+	.set _FIQ_DISABLE, 0x40 @ cuando el bit F está activo, FIQ está deshabilitado
+
+	.set _MODE_MASK, 0x1F
+	.set _FIQ_MODE, 0x11
+
+	.code 32
+	.text
+
+@
+@ Carga los registros r8-r12 del modo FIQ desde un vector de cinco palabras
+@ Permite a los manejadores de FIQ mantener su estado en los registros
+@ propios del modo sin tener que guardar ningún contexto. Sólo funciona en
+@ modos privilegiados
+@
+	.align	4
+	.global	excep_set_fiq_regs
+	.type	excep_set_fiq_regs, %function
+excep_set_fiq_regs:
+	mrs	r1, cpsr
+	bic	r2, r1, #_MODE_MASK
+	orr	r2, r2, #(_FIQ_MODE | _IRQ_DISABLE | _FIQ_DISABLE)
+	msr	cpsr_c, r2
+
+	ldmia	r0, {r8-r12}
+
+	msr	cpsr_c, r1
+	bx	lr
+
+	.size	excep_set_fiq_regs, .-excep_set_fiq_regs
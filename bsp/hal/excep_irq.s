@@ -0,0 +1,133 @@
+@
+@ Sistemas Empotrados
+@ Manejadores en ensamblador para las interrupciones normales
+@
+
+	.set _IRQ_DISABLE, 0x80 @ cuando el bit I está activo, IRQ está deshabilitado
+	.set _FIQ_DISABLE, 0x40 @ cuando el bit F está activo, FIQ está deshabilitado
+
+	.set _IRQ_MODE, 0x12
+	.set _SYS_MODE, 0x1F
+
+@
+@ Registros del ITC (ITC_BASE en system.h)
+@
+	.set _ITC_BASE, 0x80020000
+	.set _ITC_NIMASK, 0x04
+	.set _ITC_NIVECTOR, 0x28
+
+@
+@ Cuenta del temporizador de perfilado (BSP_PROFILE_TIMER en system.h)
+@
+	.set _PROFILE_CNTR, 0x8000706A
+
+@
+@ Perfilado de las fuentes de interrupción (ITC_PROFILING en bsp.mk)
+@
+	.ifndef ITC_PROFILING
+	.set ITC_PROFILING, 0
+	.endif
+
+	.code 32
+	.text
+
+@
+@ Manejador para interrupciones normales no anidadas
+@ Equivalente a excep_nonnested_irq_handler, pero sólo guarda los registros
+@ que no preserva la función llamada y salta directamente al manejador de la
+@ fuente, con su contexto en r0
+@
+	.align	4
+	.global	excep_nonnested_irq_handler_asm
+	.type	excep_nonnested_irq_handler_asm, %function
+excep_nonnested_irq_handler_asm:
+	sub	lr, lr, #4
+	stmfd	sp!, {r0-r3, r12, lr}
+
+	.if ITC_PROFILING
+	@ itc_profile_dispatch (fuente, instante de entrada)
+	ldr	r1, =_PROFILE_CNTR
+	ldrh	r1, [r1]
+	ldr	r0, =_ITC_BASE
+	ldr	r0, [r0, #_ITC_NIVECTOR]
+	ldr	r12, =itc_profile_dispatch
+	.else
+	@ Cada entrada de itc_vectors es {contexto, manejador}
+	ldr	r1, =_ITC_BASE
+	ldr	r1, [r1, #_ITC_NIVECTOR]
+	ldr	r2, =itc_vectors
+	add	r2, r2, r1, lsl #3
+	ldmia	r2, {r0, r12}
+	.endif
+	mov	lr, pc
+	bx	r12
+
+	ldmfd	sp!, {r0-r3, r12, pc}^
+
+	.size	excep_nonnested_irq_handler_asm, .-excep_nonnested_irq_handler_asm
+
+@
+@ Manejador para interrupciones normales anidadas
+@ Guarda en la pila de IRQ el contexto, spsr_irq y el NIMASK anterior, y
+@ programa NIMASK con la fuente en servicio para que el ITC sólo deje pasar
+@ las fuentes de más prioridad. Después atiende la fuente en modo SYS con las
+@ IRQ habilitadas, de modo que lr_irq y spsr_irq quedan libres para la
+@ siguiente interrupción. El manejador usa la pila del modo SYS
+@
+	.align	4
+	.global	excep_nested_irq_handler
+	.type	excep_nested_irq_handler, %function
+excep_nested_irq_handler:
+	sub	lr, lr, #4
+	stmfd	sp!, {r0-r3, r12, lr}
+
+	.if ITC_PROFILING
+	ldr	r12, =_PROFILE_CNTR
+	ldrh	r12, [r12]
+	.endif
+
+	@ La fuente se lee antes de enmascararla: con NIMASK a su nivel ya no
+	@ aparece en NIVECTOR
+	mrs	r0, spsr
+	ldr	r1, =_ITC_BASE
+	ldr	r2, [r1, #_ITC_NIMASK]
+	ldr	r3, [r1, #_ITC_NIVECTOR]
+	stmfd	sp!, {r0, r2}
+	str	r3, [r1, #_ITC_NIMASK]
+
+	@ Modo SYS con las IRQ habilitadas. lr_sys pertenece al código interrumpido.
+	@ El código interrumpido puede tener sp_sys desalineado, así que lo
+	@ alineamos a 8 bytes (AAPCS) y apilamos el original junto con lr_sys
+	msr	cpsr_c, #_SYS_MODE
+	mov	r2, sp
+	bic	sp, sp, #7
+	stmfd	sp!, {r2, lr}
+
+	.if ITC_PROFILING
+	@ itc_profile_dispatch (fuente, instante de entrada)
+	mov	r0, r3
+	mov	r1, r12
+	ldr	r12, =itc_profile_dispatch
+	.else
+	ldr	r2, =itc_vectors
+	add	r2, r2, r3, lsl #3
+	ldmia	r2, {r0, r12}
+	.endif
+	mov	lr, pc
+	bx	r12
+
+	ldmfd	sp!, {r2, lr}
+	mov	sp, r2
+	msr	cpsr_c, #(_IRQ_MODE | _IRQ_DISABLE)
+
+	@ Restauramos NIMASK y spsr_irq con las IRQ deshabilitadas
+	ldmfd	sp!, {r0, r2}
+	ldr	r1, =_ITC_BASE
+	str	r2, [r1, #_ITC_NIMASK]
+	msr	spsr_cxsf, r0
+
+	ldmfd	sp!, {r0-r3, r12, pc}^
+
+	.size	excep_nested_irq_handler, .-excep_nested_irq_handler
+
+	.ltorg
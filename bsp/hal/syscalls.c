@@ -29,11 +29,16 @@ extern int _heap_start, _heap_end;
 void * _sbrk (intptr_t incr)
 {
 	static void *current_break = &_heap_start;
-	void *last_break = current_break;
+	void *last_break;
+	itc_token_t token;
 
-	/* Anulamos las interrupciones durante el proceso de reserva */
+	/*
+	 * Enmascaramos las interrupciones normales durante el proceso de reserva.
+	 * Las rápidas nunca reservan memoria, así que pueden seguir entrando
+	 */
 	/* Comienzo de la sección crítica */
-	itc_disable_ints();
+	token = itc_enter_critical_level(ITC_LEVEL_ALL);
+	last_break = current_break;
 
 	/* Forzamos a que el incremento sea un múltiplo del tamaño de la palabra */
 	incr = (intptr_t) (((unsigned int)incr + 3) & ~3);
@@ -52,7 +57,7 @@ void * _sbrk (intptr_t incr)
 
 	/* Volvemos a habilitar las interrupciones */
 	/* Fin de la sección crítica */
-	itc_restore_ints();
+	itc_exit_critical(token);
 
 	return last_break;
 }
@@ -10,22 +10,88 @@
 
 /*****************************************************************************/
 
+/**
+ * Barrera de compilación entre el acceso a los datos y la publicación de los
+ * índices. El ARM7TDMI no reordena accesos a memoria, así que basta con
+ * impedir que lo haga el compilador. Se puede redefinir al compilar el búfer
+ * para otras arquitecturas
+ */
+#ifndef CIRCULAR_BUFFER_BARRIER
+#define CIRCULAR_BUFFER_BARRIER()	asm volatile ("" ::: "memory")
+#endif
+
+/*****************************************************************************/
+
+/**
+ * Estadísticas de uso de los búferes. Permiten dimensionar los búferes a
+ * partir de datos reales. Se eliminan compilando con -DCIRCULAR_BUFFER_STATS=0
+ */
+#ifndef CIRCULAR_BUFFER_STATS
+#define CIRCULAR_BUFFER_STATS	1
+#endif
+
+/*****************************************************************************/
+
+/**
+ * Estadísticas de un búfer circular
+ * Los campos high_water, overflows y bytes_in los actualiza el productor y el
+ * campo bytes_out el consumidor
+ */
+typedef struct
+{
+	uint32_t high_water;	/* Máximo número de bytes almacenados a la vez */
+	uint32_t overflows;		/* Bytes que no se pudieron escribir por estar lleno */
+	uint32_t bytes_in;		/* Total de bytes escritos */
+	uint32_t bytes_out;		/* Total de bytes leídos */
+	uint32_t lost;			/* Bytes sobrescritos antes de leerse (modo sobrescritura) */
+} circular_buffer_stats_t;
+
+/*****************************************************************************/
+
+/**
+ * Comportamiento del búfer cuando el productor lo encuentra lleno
+ */
+typedef enum
+{
+	circular_buffer_mode_drop = 0,	/* Se rechazan los datos nuevos */
+	circular_buffer_mode_overwrite,	/* Se sobrescriben los datos más antiguos */
+	circular_buffer_mode_max
+} circular_buffer_mode_t;
+
+/*****************************************************************************/
+
 /**
  * Estructura para gestionar un búfer circular
+ * El búfer está pensado para un único productor y un único consumidor
+ * (p.ej. una isr y el programa principal). El productor sólo modifica end y el
+ * consumidor sólo modifica start, por lo que no es necesario deshabilitar las
+ * interrupciones para acceder a él.
+ * Los índices avanzan libremente y se enmascaran con mask al acceder a data,
+ * por lo que el tamaño debe ser una potencia de dos.
+ * En modo sobrescritura el productor nunca espera ni toca start: sigue
+ * avanzando end y es el consumidor quien detecta que le han adelantado,
+ * descarta los bytes sobrescritos y los contabiliza en lost
  */
 typedef struct
 {
 	uint8_t *data;
 	uint32_t size;
+	uint32_t mask;
 	uint32_t start;
 	uint32_t end;
-	uint32_t count;
+	uint32_t mode;
+	uint32_t lost;
+#if CIRCULAR_BUFFER_STATS
+	circular_buffer_stats_t stats;
+#endif
 } circular_buffer_t;
 
 /*****************************************************************************/
 
 /**
  * Inicializa un búfer circular dado un puntero a una zona de memoria y su tamaño
+ * Si el tamaño no es una potencia de dos se usa la mayor potencia de dos que
+ * quepa en la zona de memoria
  * @param cb	Puntero a la estructura de gestión del búfer circular
  * @param addr	Puntero a la zona de memoria que se gestionará como un búfer circular
  * @param size	Tamaño en bytes del búfer
@@ -34,11 +100,281 @@ void circular_buffer_init (volatile circular_buffer_t *cb, uint8_t *addr, uint32
 
 /*****************************************************************************/
 
+/**
+ * Selecciona el comportamiento del búfer cuando se llena
+ * Debe llamarse antes de que el productor y el consumidor empiecen a usarlo
+ * @param cb	Búfer circular
+ * @param mode	circular_buffer_mode_drop para rechazar los datos nuevos o
+ * 				circular_buffer_mode_overwrite para sobrescribir los antiguos
+ */
+void circular_buffer_set_mode (volatile circular_buffer_t *cb, circular_buffer_mode_t mode);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de bytes sobrescritos antes de que el consumidor los leyera
+ * Sólo tiene sentido en modo sobrescritura
+ * @param cb	Búfer circular
+ */
+uint32_t circular_buffer_lost (volatile circular_buffer_t *cb);
+
+/*****************************************************************************/
+
+/**
+ * Operaciones del consumidor en modo sobrescritura. Las usan las operaciones
+ * básicas, no deben llamarse directamente
+ */
+void __circular_buffer_resync (volatile circular_buffer_t *cb);
+int32_t __circular_buffer_read_overwrite (volatile circular_buffer_t *cb);
+
+/*****************************************************************************/
+
+/**
+ * Escribe un bloque de bytes en un búfer circular
+ * Copia los datos en, como mucho, dos regiones contiguas del búfer
+ * Sólo debe llamarla el productor
+ * @param cb	Búfer circular
+ * @param src	Bytes a escribir
+ * @param count	Número de bytes a escribir
+ * @return		El número de bytes escritos, que puede ser menor que count si
+ * 				no hay espacio suficiente
+ */
+uint32_t circular_buffer_write_span (volatile circular_buffer_t *cb, const uint8_t *src, uint32_t count);
+
+/*****************************************************************************/
+
+/**
+ * Lee un bloque de bytes de un búfer circular
+ * Copia los datos desde, como mucho, dos regiones contiguas del búfer
+ * Sólo debe llamarla el consumidor
+ * @param cb	Búfer circular
+ * @param dst	Búfer donde se almacenarán los bytes leídos
+ * @param count	Número de bytes a leer
+ * @return		El número de bytes leídos, que puede ser menor que count si
+ * 				el búfer no tiene suficientes datos
+ */
+uint32_t circular_buffer_read_span (volatile circular_buffer_t *cb, uint8_t *dst, uint32_t count);
+
+/**
+ * Retorna las estadísticas de un búfer circular
+ * Si las estadísticas están deshabilitadas se retornan a cero
+ * @param cb	Búfer circular
+ * @param stats	Estructura donde se copian las estadísticas
+ */
+void circular_buffer_get_stats (volatile circular_buffer_t *cb, circular_buffer_stats_t *stats);
+
+/*****************************************************************************/
+
+/**
+ * Reinicia las estadísticas de un búfer circular
+ * @param cb	Búfer circular
+ */
+void circular_buffer_reset_stats (volatile circular_buffer_t *cb);
+
+/*****************************************************************************/
+
+/**
+ * Actualización de las estadísticas. Se quedan vacías si están deshabilitadas
+ */
+
+static inline void __circular_buffer_stats_in (volatile circular_buffer_t *cb, uint32_t count)
+{
+#if CIRCULAR_BUFFER_STATS
+	uint32_t used = cb->end - cb->start;
+
+	/* En modo sobrescritura el productor puede adelantar al consumidor */
+	if (used > cb->size)
+		used = cb->size;
+
+	cb->stats.bytes_in += count;
+	if (used > cb->stats.high_water)
+		cb->stats.high_water = used;
+#endif
+}
+
+static inline void __circular_buffer_stats_out (volatile circular_buffer_t *cb, uint32_t count)
+{
+#if CIRCULAR_BUFFER_STATS
+	cb->stats.bytes_out += count;
+#endif
+}
+
+/**
+ * Registra bytes que el productor no ha podido escribir por estar el búfer lleno
+ * Sólo debe llamarla el productor
+ * @param cb	Búfer circular
+ * @param count	Número de bytes
+ */
+static inline void circular_buffer_stats_overflow (volatile circular_buffer_t *cb, uint32_t count)
+{
+#if CIRCULAR_BUFFER_STATS
+	cb->stats.overflows += count;
+#endif
+}
+
+/*****************************************************************************/
+
+/**
+ * Implementación de las operaciones básicas sobre el búfer.
+ * Reciben el tamaño y la máscara como parámetros para que las versiones de
+ * tamaño fijo generadas con DEFINE_RING los conviertan en constantes y el
+ * acceso circular se reduzca a un AND con un inmediato.
+ * Son static inline para que la isr no pague el coste de una llamada por
+ * cada operación
+ */
+
+static inline uint32_t __circular_buffer_count (volatile circular_buffer_t *cb,
+		uint32_t size)
+{
+	uint32_t count = cb->end - cb->start;
+
+	/* En modo sobrescritura el productor puede adelantar al consumidor */
+	return count > size ? size : count;
+}
+
+static inline int32_t __circular_buffer_write (volatile circular_buffer_t *cb,
+		uint8_t byte, uint32_t size, uint32_t mask)
+{
+	uint32_t end = cb->end;
+
+	/*
+	 * Escribimos en el búfer sólo si hay espacio, salvo en modo sobrescritura.
+	 * El modo sólo se consulta con el búfer lleno, por lo que el caso normal
+	 * no se penaliza
+	 */
+	if (end - cb->start >= size && cb->mode == circular_buffer_mode_drop)
+	{
+		circular_buffer_stats_overflow (cb, 1);
+		return -1;
+	}
+
+	/* La posición no se puede sobrescribir antes de ver que está libre */
+	CIRCULAR_BUFFER_BARRIER ();
+	cb->data[end & mask] = byte;
+
+	/* El dato debe estar escrito antes de publicar el nuevo índice */
+	CIRCULAR_BUFFER_BARRIER ();
+	cb->end = end + 1;
+	__circular_buffer_stats_in (cb, 1);
+	return byte;
+}
+
+static inline int32_t __circular_buffer_read (volatile circular_buffer_t *cb,
+		uint32_t mask)
+{
+	int32_t byte;
+	uint32_t start;
+
+	/* En modo sobrescritura hay que comprobar que no nos han adelantado */
+	if (cb->mode == circular_buffer_mode_overwrite)
+		return __circular_buffer_read_overwrite (cb);
+
+	start = cb->start;
+	if (cb->end == start)
+		return -1;
+
+	/* El dato no se puede leer antes que el índice que lo publica */
+	CIRCULAR_BUFFER_BARRIER ();
+	byte = cb->data[start & mask];
+
+	/* El dato debe estar leído antes de liberar su posición */
+	CIRCULAR_BUFFER_BARRIER ();
+	cb->start = start + 1;
+	__circular_buffer_stats_out (cb, 1);
+	return byte;
+}
+
+static inline uint32_t __circular_buffer_peek_contiguous (volatile circular_buffer_t *cb,
+		uint8_t **addr, uint32_t size, uint32_t mask)
+{
+	uint32_t end = cb->end;
+	uint32_t index = end & mask;
+	uint32_t used = end - cb->start;
+	uint32_t free = used < size ? size - used : 0;
+
+	/*
+	 * En modo sobrescritura, con el búfer lleno, sólo se ofrece la posición
+	 * del byte más antiguo, que es la única que el consumidor no da por
+	 * válida mientras no se publique (ver __circular_buffer_resync)
+	 */
+	if (free == 0 && cb->mode == circular_buffer_mode_overwrite)
+		free = 1;
+
+	/* La región libre no puede pasar del final del búfer */
+	if (free > size - index)
+		free = size - index;
+
+	/* La región no se puede sobrescribir antes de ver que está libre */
+	CIRCULAR_BUFFER_BARRIER ();
+	*addr = cb->data + index;
+	return free;
+}
+
+static inline void __circular_buffer_commit (volatile circular_buffer_t *cb, uint32_t count)
+{
+	/* Los datos deben estar escritos antes de publicar el nuevo índice */
+	CIRCULAR_BUFFER_BARRIER ();
+	cb->end += count;
+	__circular_buffer_stats_in (cb, count);
+}
+
+static inline uint32_t __circular_buffer_peek_data (volatile circular_buffer_t *cb,
+		uint8_t **addr, uint32_t size, uint32_t mask)
+{
+	uint32_t start, index, count;
+
+	/*
+	 * En modo sobrescritura descartamos primero lo que nos hayan adelantado.
+	 * Los datos obtenidos sólo son estables si el productor no puede
+	 * interrumpir al consumidor (p.ej. si el consumidor es la isr)
+	 */
+	if (cb->mode == circular_buffer_mode_overwrite)
+		__circular_buffer_resync (cb);
+
+	start = cb->start;
+	index = start & mask;
+	count = cb->end - start;
+
+	/* La región de datos no puede pasar del final del búfer */
+	if (count > size - index)
+		count = size - index;
+
+	/* Los datos no se pueden leer antes que el índice que los publica */
+	CIRCULAR_BUFFER_BARRIER ();
+	*addr = cb->data + index;
+	return count;
+}
+
+static inline void __circular_buffer_consume (volatile circular_buffer_t *cb, uint32_t count)
+{
+	/* Los datos deben estar leídos antes de liberar su posición */
+	CIRCULAR_BUFFER_BARRIER ();
+	cb->start += count;
+	__circular_buffer_stats_out (cb, count);
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de bytes almacenados en el búfer
+ * @param cb	Búfer circular
+ */
+static inline uint32_t circular_buffer_count (volatile circular_buffer_t *cb)
+{
+	return __circular_buffer_count (cb, cb->size);
+}
+
+/*****************************************************************************/
+
 /**
  * Retorna 1 si el búfer está lleno
+ * En modo sobrescritura el búfer nunca está lleno para el productor
  * @param cb	Búfer circular
  */
-uint32_t circular_buffer_is_full (volatile circular_buffer_t *cb);
+static inline uint32_t circular_buffer_is_full (volatile circular_buffer_t *cb)
+{
+	return cb->end - cb->start >= cb->size && cb->mode == circular_buffer_mode_drop;
+}
 
 /*****************************************************************************/
 
@@ -46,28 +382,207 @@ uint32_t circular_buffer_is_full (volatile circular_buffer_t *cb);
  * Retorna 1 si el búfer está vacío
  * @param cb	Búfer circular
  */
-uint32_t circular_buffer_is_empty (volatile circular_buffer_t *cb);
+static inline uint32_t circular_buffer_is_empty (volatile circular_buffer_t *cb)
+{
+	return cb->end == cb->start;
+}
 
 /*****************************************************************************/
 
 /**
  * Escribe un byte en un búfer circular
+ * Sólo debe llamarla el productor
  * @param cb	Búfer circular
  * @param byte	Byte a escribir
  * @return		El byte como un casting de uint8_t a int32_t en caso de éxito
  * 				o -1 en caso de error
  */
-int32_t circular_buffer_write (volatile circular_buffer_t *cb, uint8_t byte);
+static inline int32_t circular_buffer_write (volatile circular_buffer_t *cb, uint8_t byte)
+{
+	return __circular_buffer_write (cb, byte, cb->size, cb->mask);
+}
 
 /*****************************************************************************/
 
 /**
  * Lee un byte en un búfer circular
+ * Sólo debe llamarla el consumidor
  * @param cb	Búfer circular
  * @return		El byte como un casting de uint8_t a int32_t en caso de éxito
  * 				o -1 en caso de error
  */
-int32_t circular_buffer_read (volatile circular_buffer_t *cb);
+static inline int32_t circular_buffer_read (volatile circular_buffer_t *cb)
+{
+	return __circular_buffer_read (cb, cb->mask);
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna la región libre contigua más grande a partir de la posición de
+ * escritura, para que el productor pueda rellenarla directamente
+ * Los datos no son visibles para el consumidor hasta llamar a circular_buffer_commit
+ * Sólo debe llamarla el productor
+ * @param cb	Búfer circular
+ * @param addr	Puntero donde se almacena la dirección de la región libre
+ * @return		El número de bytes que se pueden escribir en *addr
+ */
+static inline uint32_t circular_buffer_peek_contiguous (volatile circular_buffer_t *cb, uint8_t **addr)
+{
+	return __circular_buffer_peek_contiguous (cb, addr, cb->size, cb->mask);
+}
+
+/*****************************************************************************/
+
+/**
+ * Publica los bytes escritos directamente en la región obtenida con
+ * circular_buffer_peek_contiguous
+ * Sólo debe llamarla el productor
+ * @param cb	Búfer circular
+ * @param count	Número de bytes escritos. No debe superar el tamaño de la región
+ */
+static inline void circular_buffer_commit (volatile circular_buffer_t *cb, uint32_t count)
+{
+	__circular_buffer_commit (cb, count);
+}
+
+/*****************************************************************************/
+
+/**
+ * Retorna la región contigua más grande de datos a partir de la posición de
+ * lectura, para que el consumidor pueda procesarlos sin copiarlos
+ * Los datos no se liberan hasta llamar a circular_buffer_consume
+ * Sólo debe llamarla el consumidor
+ * @param cb	Búfer circular
+ * @param addr	Puntero donde se almacena la dirección de los datos
+ * @return		El número de bytes que se pueden leer de *addr
+ */
+static inline uint32_t circular_buffer_peek_data (volatile circular_buffer_t *cb, uint8_t **addr)
+{
+	return __circular_buffer_peek_data (cb, addr, cb->size, cb->mask);
+}
+
+/*****************************************************************************/
+
+/**
+ * Libera los bytes procesados directamente en la región obtenida con
+ * circular_buffer_peek_data
+ * Sólo debe llamarla el consumidor
+ * @param cb	Búfer circular
+ * @param count	Número de bytes procesados. No debe superar el tamaño de la región
+ */
+static inline void circular_buffer_consume (volatile circular_buffer_t *cb, uint32_t count)
+{
+	__circular_buffer_consume (cb, count);
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe un byte en la región libre, offset posiciones después de la
+ * posición de escritura, sin publicarlo. Permite que el productor prepare un
+ * bloque completo que el consumidor ve de una vez al llamar a
+ * circular_buffer_commit
+ * Sólo debe llamarla el productor, y offset no debe superar el espacio libre
+ * @param cb		Búfer circular
+ * @param offset	Posición relativa a la de escritura
+ * @param byte		Byte a escribir
+ */
+static inline void circular_buffer_stage (volatile circular_buffer_t *cb, uint32_t offset, uint8_t byte)
+{
+	cb->data[(cb->end + offset) & cb->mask] = byte;
+}
+
+/*****************************************************************************/
+
+/**
+ * Lee un byte de los datos almacenados, offset posiciones después de la
+ * posición de lectura, sin liberarlo
+ * Sólo debe llamarla el consumidor
+ * @param cb		Búfer circular
+ * @param offset	Posición relativa a la de lectura
+ * @return		El byte como un casting de uint8_t a int32_t o -1 si el búfer
+ * 				no tiene tantos datos
+ */
+static inline int32_t circular_buffer_peek (volatile circular_buffer_t *cb, uint32_t offset)
+{
+	uint32_t start = cb->start;
+
+	if (offset >= cb->end - start)
+		return -1;
+
+	/* El dato no se puede leer antes que el índice que lo publica */
+	CIRCULAR_BUFFER_BARRIER ();
+	return cb->data[(start + offset) & cb->mask];
+}
+
+/*****************************************************************************/
+
+/**
+ * Genera las operaciones de un búfer circular de tamaño fijo en tiempo de
+ * compilación. Para un nombre "name" define name_ring_init, name_ring_count,
+ * name_ring_is_full, name_ring_is_empty, name_ring_write, name_ring_read,
+ * name_ring_peek_contiguous, name_ring_commit, name_ring_peek_data y
+ * name_ring_consume, que trabajan sobre un circular_buffer_t normal, por lo
+ * que se pueden mezclar con el resto de operaciones del búfer.
+ * Ejemplo:
+ * 		DEFINE_RING(uart_rx, 256)
+ * @param name	Prefijo de las operaciones
+ * @param size	Tamaño del búfer. Debe ser una potencia de dos
+ */
+#define DEFINE_RING(name, size)																	\
+																								\
+typedef char name##_ring_size_must_be_a_power_of_two[((size) & ((size) - 1)) == 0 ? 1 : -1];	\
+																								\
+static inline void name##_ring_init (volatile circular_buffer_t *cb, uint8_t *addr)				\
+{																								\
+	circular_buffer_init (cb, addr, (size));													\
+}																								\
+																								\
+static inline uint32_t name##_ring_count (volatile circular_buffer_t *cb)						\
+{																								\
+	return __circular_buffer_count (cb, (size));												\
+}																								\
+																								\
+static inline uint32_t name##_ring_is_full (volatile circular_buffer_t *cb)						\
+{																								\
+	return cb->end - cb->start >= (size) && cb->mode == circular_buffer_mode_drop;				\
+}																								\
+																								\
+static inline uint32_t name##_ring_is_empty (volatile circular_buffer_t *cb)					\
+{																								\
+	return cb->end == cb->start;																\
+}																								\
+																								\
+static inline int32_t name##_ring_write (volatile circular_buffer_t *cb, uint8_t byte)			\
+{																								\
+	return __circular_buffer_write (cb, byte, (size), (size) - 1);								\
+}																								\
+																								\
+static inline int32_t name##_ring_read (volatile circular_buffer_t *cb)							\
+{																								\
+	return __circular_buffer_read (cb, (size) - 1);												\
+}																								\
+																								\
+static inline uint32_t name##_ring_peek_contiguous (volatile circular_buffer_t *cb, uint8_t **addr)	\
+{																								\
+	return __circular_buffer_peek_contiguous (cb, addr, (size), (size) - 1);					\
+}																								\
+																								\
+static inline void name##_ring_commit (volatile circular_buffer_t *cb, uint32_t count)			\
+{																								\
+	__circular_buffer_commit (cb, count);														\
+}																								\
+																								\
+static inline uint32_t name##_ring_peek_data (volatile circular_buffer_t *cb, uint8_t **addr)	\
+{																								\
+	return __circular_buffer_peek_data (cb, addr, (size), (size) - 1);							\
+}																								\
+																								\
+static inline void name##_ring_consume (volatile circular_buffer_t *cb, uint32_t count)			\
+{																								\
+	__circular_buffer_consume (cb, count);														\
+}
 
 /*****************************************************************************/
 
@@ -155,9 +155,31 @@ void excep_nonnested_irq_handler_asm ();
 
 /**
  * Manejador en ensamblador para interrupciones normales anidadas
+ * Mientras se atiende una fuente, NIMASK bloquea esa prioridad y las
+ * inferiores, pero las fuentes de más prioridad pueden interrumpir al
+ * manejador. Los manejadores de las fuentes se ejecutan en modo SYS
  */
 void excep_nested_irq_handler ();
 
 /*****************************************************************************/
 
+/**
+ * Manejador en C para las interrupciones rápidas
+ * Da servicio a la fuente rápida pendiente a través del ITC. Los drivers
+ * pueden sustituirlo por un manejador propio que mantenga su estado en los
+ * registros r8-r12 del modo FIQ
+ */
+void excep_fiq_handler ();
+
+/*****************************************************************************/
+
+/**
+ * Carga los registros r8-r12 del modo FIQ
+ * Esta función sólo funciona en modos privilegiados
+ * @param regs	Valores de r8 a r12
+ */
+void excep_set_fiq_regs (const uint32_t *regs);
+
+/*****************************************************************************/
+
 #endif /* __EXCEP_H__ */
@@ -12,6 +12,7 @@
 
 /**
  * Fuentes de interrupción externas
+ * La prioridad de las fuentes normales es fija y crece con su número
  */
 typedef enum
 {
@@ -48,6 +49,61 @@ typedef enum
  */
 typedef void (* itc_handler_t) (void);
 
+/**
+ * Prototipo para los manejadores de interrupción con contexto
+ */
+typedef void (* itc_ctx_handler_t) (void *ctx);
+
+/*****************************************************************************/
+
+/**
+ * Estado del ITC que restaura itc_exit_critical
+ */
+typedef uint32_t itc_token_t;
+
+/**
+ * Conjunto de fuentes para itc_enter_critical_sources
+ */
+#define ITC_SRC(src)		(1u << (src))
+
+/**
+ * Nivel de itc_enter_critical_level que enmascara todas las fuentes normales
+ */
+#define ITC_LEVEL_ALL		(itc_src_max - 1)
+
+/*****************************************************************************/
+
+/**
+ * Perfilado de las fuentes de interrupción. Se activa con ITC_PROFILING=1 en
+ * bsp.mk y desaparece por completo con -DITC_PROFILING=0
+ */
+#ifndef ITC_PROFILING
+#define ITC_PROFILING	0
+#endif
+
+#if ITC_PROFILING
+
+/**
+ * Perfil de una fuente de interrupción, en ciclos de CPU medidos con
+ * BSP_PROFILE_TIMER. El temporizador es de 16 bits y cuenta a CPU_FREQ
+ * dividida por 2^BSP_PROFILE_DIV: con tmr_div_16 la resolución es de 16
+ * ciclos (0,67 us a 24 MHz) y cada medida se limita a 65535 cuentas (43,7 ms).
+ * La duración de un manejador incluye la de las
+ * interrupciones anidadas que lo interrumpan. La latencia se mide desde la
+ * entrada en la excepción hasta la llamada al manejador, ya que el ITC no
+ * registra el instante en el que se activó la petición
+ */
+typedef struct
+{
+	uint32_t count;			/* Veces que se ha atendido la fuente */
+	uint32_t total_cycles;	/* Ciclos totales en el manejador */
+	uint32_t max_cycles;	/* Máximo de ciclos en el manejador */
+	uint32_t total_latency;	/* Ciclos totales desde la entrada en la excepción */
+	uint32_t max_latency;	/* Máximo de ciclos desde la entrada en la excepción */
+} itc_profile_t;
+
+#endif
+
 /*****************************************************************************/
 
 /**
@@ -62,7 +118,10 @@ void itc_init ();
 
 /**
  * Deshabilita el envío de peticiones de interrupción a la CPU
- * Permite implementar regiones críticas en modo USER
+ * Permite implementar regiones críticas en modo USER. Las llamadas se pueden
+ * anidar: sólo la última llamada a itc_restore_ints vuelve a habilitarlas.
+ * Es preferible usar itc_enter_critical_level o itc_enter_critical_sources,
+ * que sólo retienen las fuentes que compiten por los datos
  */
 void itc_disable_ints ();
 
@@ -76,8 +135,42 @@ void itc_restore_ints ();
 
 /*****************************************************************************/
 
+/**
+ * Entra en una sección crítica enmascarando con NIMASK las fuentes normales de
+ * prioridad igual o inferior a level. Las fuentes de más prioridad y las
+ * rápidas siguen interrumpiendo. Si ya había un nivel mayor enmascarado se
+ * mantiene, por lo que las secciones críticas se pueden anidar
+ * @param level		Prioridad máxima enmascarada. ITC_LEVEL_ALL enmascara
+ * 					todas las fuentes normales
+ * @return	Token que se debe pasar a itc_exit_critical
+ */
+itc_token_t itc_enter_critical_level (uint32_t level);
+
+/*****************************************************************************/
+
+/**
+ * Entra en una sección crítica deshabilitando un conjunto de fuentes, normales
+ * o rápidas. Las secciones críticas se pueden anidar
+ * @param sources	Conjunto de fuentes, construido con ITC_SRC
+ * @return	Token que se debe pasar a itc_exit_critical
+ */
+itc_token_t itc_enter_critical_sources (uint32_t sources);
+
+/*****************************************************************************/
+
+/**
+ * Sale de una sección crítica restaurando el estado anterior del ITC
+ * Las secciones anidadas deben cerrarse en orden inverso al de entrada
+ * @param token		Token retornado al entrar en la sección crítica
+ */
+void itc_exit_critical (itc_token_t token);
+
+/*****************************************************************************/
+
 /**
  * Asigna un manejador de interrupción
+ * Los manejadores del propio BSP usan itc_set_handler_ctx, que se ahorra la
+ * llamada intermedia
  * @param src		Identificador de la fuente
  * @param handler	Manejador
  */
@@ -85,6 +178,18 @@ void itc_set_handler (itc_src_t src, itc_handler_t handler);
 
 /*****************************************************************************/
 
+/**
+ * Asigna un manejador de interrupción que recibe un contexto
+ * Permite que un mismo manejador atienda varias fuentes sin necesidad de una
+ * función intermedia por fuente
+ * @param src		Identificador de la fuente
+ * @param handler	Manejador
+ * @param ctx		Contexto que recibirá el manejador como argumento
+ */
+void itc_set_handler_ctx (itc_src_t src, itc_ctx_handler_t handler, void *ctx);
+
+/*****************************************************************************/
+
 /**
  * Asigna una prioridad (normal o fast) a una fuente de interrupción
  * @param src		Identificador de la fuente
@@ -130,6 +235,7 @@ void itc_unforce_interrupt (itc_src_t src);
  */
 void itc_service_normal_interrupt ();
 
+
 /*****************************************************************************/
 
 /**
@@ -139,4 +245,44 @@ void itc_service_fast_interrupt ();
 
 /*****************************************************************************/
 
+#if ITC_PROFILING
+
+/**
+ * Llama al manejador de una fuente y actualiza su perfil
+ * La usan los manejadores de excepción en lugar de saltar directamente al
+ * manejador cuando el perfilado está activo
+ * @param src		Identificador de la fuente
+ * @param entry		Cuenta de BSP_PROFILE_TIMER al entrar en la excepción
+ */
+void itc_profile_dispatch (itc_src_t src, uint32_t entry);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el perfil de una fuente de interrupción
+ * @param src		Identificador de la fuente
+ * @param profile	Estructura donde se copia el perfil
+ */
+void itc_get_profile (itc_src_t src, itc_profile_t *profile);
+
+/*****************************************************************************/
+
+/**
+ * Reinicia los perfiles de todas las fuentes de interrupción
+ */
+void itc_reset_profile ();
+
+/*****************************************************************************/
+
+/**
+ * Escribe una tabla con los perfiles de las fuentes atendidas en un
+ * descriptor de fichero, p.ej. el de una uart
+ * @param fd		Descriptor de fichero
+ */
+void itc_dump_profile (int fd);
+
+#endif /* ITC_PROFILING */
+
+/*****************************************************************************/
+
 #endif /* __ITC_H__ */
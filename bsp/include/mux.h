@@ -0,0 +1,128 @@
+/*
+ * Sistemas operativos empotrados
+ * Multiplexación de canales lógicos sobre una uart
+ */
+
+#ifndef __MUX_H__
+#define __MUX_H__
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "uart.h"
+
+/*****************************************************************************/
+
+/**
+ * Definición de los canales lógicos
+ */
+typedef enum
+{
+	mux_console,		/* Consola interactiva */
+	mux_trace,			/* Trazas y registros */
+	mux_data,			/* Transferencias masivas */
+	mux_control,		/* Mensajes de control */
+	mux_max
+} mux_channel_t;
+
+/*****************************************************************************/
+
+/**
+ * Máximo número de bytes de datos por trama. Limita cuánto puede retrasar un
+ * canal a los demás
+ */
+#define MUX_MAX_PAYLOAD	64
+
+/*****************************************************************************/
+
+/**
+ * Inicializa la multiplexación sobre una uart ya inicializada y registra un
+ * dispositivo por canal
+ * Cada trama es una trama SLIP con CRC (ver uart_slip_send) cuyo primer byte
+ * identifica el canal. La uart no debe usarse directamente mientras tanto
+ * @param uart	Identificador de la uart
+ * @param names	Nombres de los dispositivos, uno por canal
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t mux_init (uart_id_t uart, const char * const names[mux_max]);
+
+/*****************************************************************************/
+
+/**
+ * Mueve las tramas entre la uart y los búferes de los canales
+ * Reparte las tramas recibidas entre los canales y envía como mucho una trama
+ * por canal y ronda mientras quede espacio en la uart, para que un canal con
+ * mucho tráfico no retrase a los demás. Las funciones read y write de los
+ * canales la llaman, pero también debe llamarse periódicamente desde el bucle
+ * del programa principal
+ */
+void mux_poll (void);
+
+/*****************************************************************************/
+
+/**
+ * Transmisión por un canal
+ * La llamada es no bloqueante
+ * @param channel	Canal
+ * @param buf		Búfer con los datos
+ * @param count		Número de bytes a escribir
+ * @return	El número de bytes almacenados en el búfer del canal en caso de
+ * 		éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t mux_write (uint32_t channel, char *buf, size_t count);
+
+/*****************************************************************************/
+
+/**
+ * Recepción por un canal
+ * La llamada es no bloqueante
+ * @param channel	Canal
+ * @param buf		Búfer para almacenar los bytes
+ * @param count		Número de bytes a leer
+ * @return	El número de bytes realmente leídos en caso de éxito o
+ *              -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t mux_read (uint32_t channel, char *buf, size_t count);
+
+/*****************************************************************************/
+
+/**
+ * Función fstat de los dispositivos de los canales
+ * st_size es el número de bytes que se pueden leer sin esperar y st_blksize
+ * el tamaño del búfer de recepción del canal
+ * @param channel	Canal
+ * @param buf		Estructura stat a rellenar
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int mux_fstat (uint32_t channel, struct stat *buf);
+
+/*****************************************************************************/
+
+/**
+ * Retorna las estadísticas de los búferes de un canal
+ * @param channel	Canal
+ * @param rx		Estadísticas del búfer de recepción. Puede ser NULL
+ * @param tx		Estadísticas del búfer de transmisión. Puede ser NULL
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t mux_get_buffer_stats (mux_channel_t channel, circular_buffer_stats_t *rx, circular_buffer_stats_t *tx);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el número de tramas recibidas por un canal que se han descartado
+ * por no caber enteras en su búfer de recepción
+ * @param channel	Canal
+ * @param frames	Tramas descartadas
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t mux_get_dropped_frames (mux_channel_t channel, uint32_t *frames);
+
+/*****************************************************************************/
+
+#endif /* __MUX_H__ */
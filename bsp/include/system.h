@@ -11,7 +11,9 @@
 
 #include "itc.h"
 #include "gpio.h"
+#include "tmr.h"
 #include "uart.h"
+#include "mux.h"
 
 /*
  * Configuración de la CPU
@@ -20,12 +22,17 @@
 /* Frecuencia de la CPU por defecto (24 MHz) */
 #define CPU_FREQ               24000000u
 
-/* Máximo número de dispositivos gestionables por el BSP */
-#define BSP_MAX_DEV 8
+/* Máximo número de dispositivos gestionables por el BSP. Los canales multiplexados ocupan cuatro más */
+#define BSP_MAX_DEV (BSP_MUX ? 12 : 8)
 
 /* Máximo número de ficheros (dispositivos) abiertos simultánemente */
 #define BSP_MAX_FD 8
 
+/* Interrupciones normales anidadas según su prioridad en el ITC */
+#ifndef BSP_NESTED_IRQ
+#define BSP_NESTED_IRQ 1
+#endif
+
 /*
  * Configuración del GPIO
  */
@@ -35,16 +42,57 @@
 
 /*
  * Configuración de las UART
+ * El baudrate puede ser UART_AUTOBAUD para arrancar al baudrate por defecto;
+ * la aplicación debe llamar después a uart_autobaud para detectarlo
  */
 #define UART1_BASE 		((void *) 0x80005000)
 #define UART1_ID		(uart_1)
+#ifndef UART1_BAUDRATE
 #define UART1_BAUDRATE	(115200)
+#endif
 #define UART1_NAME 		"/dev/uart1"
+#define UART1_SLIP_NAME	"/dev/uart1f"
+#define UART1_RX_BUFFER_SIZE	(64)
+#define UART1_TX_BUFFER_SIZE	(256)
+#define UART1_RX_TIMER	(tmr_1)
+#define UART1_RX_LEVEL_MIN	(1)
+#define UART1_RX_LEVEL_MAX	(16)
+#define UART1_RX_TIMEOUT	(4)
+#define UART1_FLOW_CONTROL	(uart_flow_none)
 
 #define UART2_BASE 		((void *) 0x8000b000)
 #define UART2_ID		(uart_2)
+#ifndef UART2_BAUDRATE
 #define UART2_BAUDRATE	(115200)
+#endif
 #define UART2_NAME 		"/dev/uart2"
+#define UART2_SLIP_NAME	"/dev/uart2f"
+#define UART2_RX_BUFFER_SIZE	(1024)
+#define UART2_TX_BUFFER_SIZE	(256)
+#define UART2_RX_TIMER	(tmr_2)
+#define UART2_RX_LEVEL_MIN	(1)
+#define UART2_RX_LEVEL_MAX	(24)
+#define UART2_RX_TIMEOUT	(4)
+#define UART2_FLOW_CONTROL	(uart_flow_none)
+#ifndef UART2_FIQ
+#define UART2_FIQ		(0)		/* Recepción por FIQ, con umbral fijo de un byte */
+#endif
+
+/*
+ * Configuración de los canales multiplexados
+ * Comparten la uart2 con tramas SLIP etiquetadas con el canal. Mientras están
+ * activos la uart no debe usarse directamente
+ */
+#ifndef BSP_MUX
+#define BSP_MUX			(0)		/* Activa los canales multiplexados */
+#endif
+#define MUX_UART		(uart_2)
+#define MUX_CONSOLE_NAME	"/dev/mux0"
+#define MUX_TRACE_NAME		"/dev/mux1"
+#define MUX_DATA_NAME		"/dev/mux2"
+#define MUX_CONTROL_NAME	"/dev/mux3"
+#define MUX_RX_BUFFER_SIZE	(128)
+#define MUX_TX_BUFFER_SIZE	(256)
 
 /*
  * Configuración de E/S estándar
@@ -58,5 +106,13 @@
  */
 #define ITC_BASE		((void *) 0x80020000)
 
+/*
+ * Configuración de los temporizadores
+ */
+#define TMR_BASE		((void *) 0x80007000)
+#define BSP_TICK_TIMER	(tmr_0)					/* Libre, a CPU_FREQ */
+#define BSP_PROFILE_TIMER	(tmr_3)				/* Libre, sólo con ITC_PROFILING */
+#define BSP_PROFILE_DIV		(tmr_div_16)		/* Resolución del perfilado: 16 ciclos */
+
 
 #endif /* __SYSTEM_H_ */
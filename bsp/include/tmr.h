@@ -0,0 +1,103 @@
+/*
+ * Sistemas operativos empotrados
+ * Driver para los temporizadores del MC1322x
+ */
+
+#ifndef __TMR_H__
+#define __TMR_H__
+
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/**
+ * Definición de los temporizadores del sistema
+ */
+typedef enum
+{
+	tmr_0,
+	tmr_1,
+	tmr_2,
+	tmr_3,
+	tmr_max
+} tmr_id_t;
+
+/*****************************************************************************/
+
+/**
+ * Divisores del reloj del bus (CPU_FREQ) que alimenta los temporizadores
+ */
+typedef enum
+{
+	tmr_div_1,
+	tmr_div_2,
+	tmr_div_4,
+	tmr_div_8,
+	tmr_div_16,
+	tmr_div_32,
+	tmr_div_64,
+	tmr_div_128,
+	tmr_div_max
+} tmr_div_t;
+
+/*****************************************************************************/
+
+/**
+ * Definición para las funciones de callback de los temporizadores
+ * Se invocan desde la isr
+ */
+typedef void (* tmr_callback_t) (tmr_id_t tmr);
+
+/*****************************************************************************/
+
+/**
+ * Inicializa los temporizadores. Los deja parados y registra su manejador
+ * de interrupción en el ITC
+ */
+void tmr_init (void);
+
+/*****************************************************************************/
+
+/**
+ * Arranca un temporizador en modo libre. Cuenta de 0 a 0xffff y vuelve a 0
+ * sin generar interrupciones
+ * @param tmr	Identificador del temporizador
+ * @param div	Divisor del reloj
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_start_free_running (tmr_id_t tmr, tmr_div_t div);
+
+/*****************************************************************************/
+
+/**
+ * Arranca un temporizador de un solo disparo. Si ya estaba en marcha vuelve
+ * a empezar la cuenta
+ * @param tmr		Identificador del temporizador
+ * @param div		Divisor del reloj
+ * @param ticks		Número de ciclos del reloj dividido hasta el disparo
+ * @param callback	Función invocada desde la isr al vencer la cuenta
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t tmr_start_oneshot (tmr_id_t tmr, tmr_div_t div, uint16_t ticks, tmr_callback_t callback);
+
+/*****************************************************************************/
+
+/**
+ * Detiene un temporizador
+ * @param tmr	Identificador del temporizador
+ */
+void tmr_stop (tmr_id_t tmr);
+
+/*****************************************************************************/
+
+/**
+ * Retorna la cuenta actual de un temporizador
+ * @param tmr	Identificador del temporizador
+ */
+uint16_t tmr_read (tmr_id_t tmr);
+
+/*****************************************************************************/
+
+#endif /* __TMR_H__ */
@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include "circular_buffer.h"
 
 /*****************************************************************************/
 
@@ -25,15 +27,175 @@ typedef enum
 
 /**
  * Definición para las funciones de callback
+ * En recepción count es el número de bytes disponibles en el búfer de
+ * recepción, o el de tramas completas en modo de tramas, y en transmisión el
+ * espacio libre en el búfer de transmisión
  */
-typedef void (* uart_callback_t) (void);
+typedef void (* uart_callback_t) (uart_id_t uart, uint32_t count);
 
 /*****************************************************************************/
 
 /**
- * Inicializa una uart
+ * Contexto en el que se ejecutan las funciones de callback
+ */
+typedef enum
+{
+	uart_callback_isr = 0,		/* Desde la isr, en cada interrupción */
+	uart_callback_deferred,		/* Desde uart_dispatch_callbacks, fuera de la isr */
+	uart_callback_max
+} uart_callback_mode_t;
+
+/*****************************************************************************/
+
+/**
+ * Descriptor de una transmisión asíncrona sin copias
+ * El búfer pertenece al llamador y no debe modificarse hasta que se invoque
+ * la función done
+ */
+typedef struct uart_tx_desc uart_tx_desc_t;
+
+/**
+ * Definición para las funciones de finalización de una transmisión asíncrona
+ * Se invocan desde la isr cuando el último byte del descriptor ha pasado a la
+ * FIFO de transmisión
+ */
+typedef void (* uart_tx_done_t) (uart_tx_desc_t *desc);
+
+struct uart_tx_desc
+{
+	const char *buf;		/* Datos a transmitir */
+	size_t len;				/* Número de bytes a transmitir */
+	uart_tx_done_t done;	/* Función de finalización. Puede ser NULL */
+	void *ctx;				/* Dato libre para el llamador */
+
+	/* Campos de uso interno del driver */
+	uart_tx_desc_t *next;
+	size_t sent;
+};
+
+/*****************************************************************************/
+
+/**
+ * Configuración de los búferes de una uart
+ */
+typedef struct
+{
+	uint8_t *rx_buffer;		/* Memoria del búfer de recepción. NULL para que la ponga el driver */
+	uint32_t rx_size;		/* Tamaño del búfer de recepción. Cero para el tamaño por defecto */
+	uint8_t *tx_buffer;		/* Memoria del búfer de transmisión. NULL para que la ponga el driver */
+	uint32_t tx_size;		/* Tamaño del búfer de transmisión. Cero para el tamaño por defecto */
+} uart_config_t;
+
+/*****************************************************************************/
+
+/**
+ * Configuración del umbral adaptativo de interrupción de recepción
+ * Con tráfico interactivo la FIFO interrumpe con min_level bytes. Durante
+ * una ráfaga el umbral se duplica en cada interrupción hasta max_level, y
+ * cuando la línea queda en silencio durante timeout caracteres se vacía la
+ * FIFO aunque no se haya alcanzado el umbral y se vuelve a min_level
+ */
+typedef struct
+{
+	uint8_t min_level;		/* Umbral con tráfico interactivo (1 a 31) */
+	uint8_t max_level;		/* Umbral máximo durante las ráfagas (min_level a 31) */
+	uint8_t timeout;		/* Silencio, en caracteres, tras el que se vacía la FIFO */
+} uart_rx_threshold_t;
+
+/*****************************************************************************/
+
+/**
+ * Modos de control de flujo de las uart
+ */
+typedef enum
+{
+	uart_flow_none = 0,		/* Sin control de flujo */
+	uart_flow_rtscts,		/* Control de flujo hardware con las líneas RTS/CTS */
+	uart_flow_xonxoff,		/* Control de flujo software con los caracteres XON/XOFF */
+	uart_flow_max
+} uart_flow_t;
+
+/*****************************************************************************/
+
+/**
+ * Máximo número de tramas de recepción por uart
+ */
+#define UART_MAX_FRAMES	8
+
+/**
+ * Configuración de la recepción por tramas
+ * Una trama termina cuando la línea queda en silencio durante gap caracteres
+ * o cuando se llena. El búfer se divide en frames tramas de frame_size bytes
+ */
+typedef struct
+{
+	uint8_t *buffer;		/* Memoria para frames * frame_size bytes */
+	uint32_t frame_size;	/* Tamaño máximo de una trama */
+	uint32_t frames;		/* Número de tramas (2 a UART_MAX_FRAMES) */
+	uint32_t gap;			/* Silencio, en caracteres, que separa dos tramas (1 a 255) */
+} uart_frame_config_t;
+
+/**
+ * Trama recibida. Los datos siguen en el búfer de tramas de la uart hasta
+ * que se libera con uart_release_frame
+ */
+typedef struct
+{
+	uint8_t *data;
+	uint32_t len;
+} uart_frame_t;
+
+/*****************************************************************************/
+
+/**
+ * Baudrate especial para uart_init: la uart arranca a UART_AUTOBAUD_DEFAULT
+ * y la aplicación puede detectar después el baudrate con uart_autobaud
+ */
+#define UART_AUTOBAUD			0
+#define UART_AUTOBAUD_DEFAULT	115200
+
+/*****************************************************************************/
+
+/**
+ * Resultado del cálculo del divisor de baudrate
+ * baudrate = CPU_FREQ / oversampling * inc / mod
+ */
+typedef struct
+{
+	uint32_t baudrate;		/* Baudrate conseguido */
+	int32_t error_ppm;		/* Error respecto al solicitado, en partes por millón */
+	uint16_t inc;			/* Valor del campo BRINC */
+	uint16_t mod;			/* Valor del campo BRMOD */
+	uint8_t oversampling;	/* Muestras por bit: 16, u 8 para las velocidades más altas */
+} uart_baudrate_t;
+
+/*****************************************************************************/
+
+/**
+ * Contadores de errores y actividad de una uart
+ * Permiten distinguir el ruido en la línea (errores de trama o paridad) de la
+ * falta de servicio (desbordamientos de la FIFO de recepción)
+ */
+typedef struct
+{
+	uint32_t framing_errors;	/* FE: bit de parada incorrecto */
+	uint32_t parity_errors;		/* PE: paridad incorrecta */
+	uint32_t start_errors;		/* SE: bit de inicio incorrecto */
+	uint32_t rx_overruns;		/* ROE: byte recibido con la FIFO de recepción llena */
+	uint32_t rx_underruns;		/* RUE: lectura con la FIFO de recepción vacía */
+	uint32_t tx_overruns;		/* TOE: escritura con la FIFO de transmisión llena */
+	uint32_t bytes_in;			/* Bytes leídos de la FIFO de recepción */
+	uint32_t bytes_out;			/* Bytes escritos en la FIFO de transmisión */
+	uint32_t interrupts;		/* Invocaciones de la isr */
+	uint32_t frame_errors;		/* Tramas SLIP descartadas por CRC, escape o longitud */
+} uart_stats_t;
+
+/*****************************************************************************/
+
+/**
+ * Inicializa una uart con búferes de tamaño por defecto
  * @param uart	Identificador de la uart
- * @param br	Baudrate
+ * @param br	Baudrate, o UART_AUTOBAUD para arrancar a UART_AUTOBAUD_DEFAULT
  * @param name	Nombre del dispositivo
  * @return		Cero en caso de éxito o -1 en caso de error.
  * 				La condición de error se indica en la variable global errno
@@ -42,6 +204,71 @@ int32_t uart_init (uart_id_t uart, uint32_t br, const char *name);
 
 /*****************************************************************************/
 
+/**
+ * Inicializa una uart
+ * Los tamaños de los búferes deben ser potencias de dos. Si no lo son se usa
+ * la mayor potencia de dos que quepa. Un tamaño cero selecciona el tamaño por
+ * defecto. Un búfer nulo del tamaño por defecto usa memoria estática del
+ * driver, y uno nulo de otro tamaño se reserva con malloc y se libera al
+ * volver a inicializar la uart
+ * Con UART_AUTOBAUD la uart arranca a UART_AUTOBAUD_DEFAULT sin detectar
+ * nada. Para detectar el baudrate la aplicación debe llamar después a
+ * uart_autobaud
+ * @param uart	Identificador de la uart
+ * @param br	Baudrate, o UART_AUTOBAUD para arrancar a UART_AUTOBAUD_DEFAULT
+ * @param name	Nombre del dispositivo
+ * @param cfg	Configuración de los búferes. Puede ser NULL para usar la
+ * 				configuración por defecto
+ * @return		Cero en caso de éxito o -1 en caso de error.
+ * 				La condición de error se indica en la variable global errno
+ */
+int32_t uart_init_ex (uart_id_t uart, uint32_t br, const char *name, const uart_config_t *cfg);
+
+/*****************************************************************************/
+
+/**
+ * Calcula el mejor divisor INC/MOD para un baudrate sin modificar ninguna uart
+ * @param br		Baudrate solicitado
+ * @param result	Divisor elegido, baudrate conseguido y error
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_compute_baudrate (uint32_t br, uart_baudrate_t *result);
+
+/*****************************************************************************/
+
+/**
+ * Cambia el baudrate de una uart en funcionamiento
+ * Los bytes que se estén transmitiendo o recibiendo en ese momento se pierden,
+ * así que conviene llamarla con la línea en reposo
+ * @param uart		Identificador de la uart
+ * @param br		Baudrate
+ * @param result	Si no es NULL, divisor elegido, baudrate conseguido y error
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_baudrate (uart_id_t uart, uint32_t br, uart_baudrate_t *result);
+
+/*****************************************************************************/
+
+/**
+ * Detecta el baudrate del otro extremo y lo programa en la uart
+ * El otro extremo debe enviar repetidamente el carácter de sincronización 'U'
+ * (0x55), cuyos bits alternan entre 0 y 1. Se mide el carácter muestreando
+ * el pin de recepción con el temporizador BSP_TICK_TIMER y se confirma la
+ * estimación recibiendo dos caracteres 'U' correctos con la propia uart,
+ * probando los baudrates estándar del más cercano al más lejano
+ * Es bloqueante y deshabilita la recepción por interrupciones mientras dura
+ * @param uart		Identificador de la uart
+ * @param timeout	Tiempo máximo de espera en milisegundos
+ * @param result	Si no es NULL, divisor elegido, baudrate conseguido y error
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_autobaud (uart_id_t uart, uint32_t timeout, uart_baudrate_t *result);
+
+/*****************************************************************************/
+
 /**
  * Transmite un byte por la uart
  * Implementación del driver de nivel 0. La llamada se bloquea hasta que transmite el byte
@@ -62,6 +289,81 @@ uint8_t uart_receive_byte (uart_id_t uart);
 
 /*****************************************************************************/
 
+/**
+ * Intenta transmitir un byte por la uart sin esperar
+ * Implementación del driver de nivel 0. Si no hay nada pendiente de enviar el
+ * byte se escribe directamente en la FIFO; si no, se añade al búfer de
+ * transmisión detrás de lo pendiente para conservar el orden
+ * @param uart	Identificador de la uart
+ * @param c		El carácter
+ * @return	El carácter en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(EAGAIN si no hay sitio ni en la FIFO ni en el búfer)
+ */
+int32_t uart_try_send_byte (uart_id_t uart, uint8_t c);
+
+/*****************************************************************************/
+
+/**
+ * Transmite un byte por la uart esperando como mucho timeout microsegundos
+ * Implementación del driver de nivel 0, con la misma semántica que
+ * uart_try_send_byte
+ * @param uart		Identificador de la uart
+ * @param c			El carácter
+ * @param timeout	Tiempo máximo de espera en microsegundos
+ * @return	El carácter en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(ETIMEDOUT si vence el plazo)
+ */
+int32_t uart_send_byte_timeout (uart_id_t uart, uint8_t c, uint32_t timeout);
+
+/*****************************************************************************/
+
+/**
+ * Transmite un byte por la uart adelantándolo a lo pendiente en el búfer de
+ * transmisión, que no se vacía ni se modifica
+ * Implementación del driver de nivel 0 para mensajes de error graves. Ignora
+ * el XOFF del otro extremo y espera hueco en la FIFO como mucho el tiempo de
+ * dos caracteres, ya que con CTS desactivado la FIFO podría no vaciarse nunca
+ * @param uart	Identificador de la uart
+ * @param c		El carácter
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(ETIMEDOUT si la FIFO no tiene hueco a tiempo)
+ */
+int32_t uart_send_byte_urgent (uart_id_t uart, uint8_t c);
+
+/*****************************************************************************/
+
+/**
+ * Intenta recibir un byte por la uart sin esperar
+ * Implementación del driver de nivel 0. Lee del búfer de recepción o, si está
+ * vacío, de la FIFO, donde puede haber bytes por debajo del umbral
+ * @param uart	Identificador de la uart
+ * @return	El byte como un casting de uint8_t a int32_t en caso de éxito o
+ * 		-1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(EAGAIN si no hay ningún byte)
+ */
+int32_t uart_try_receive_byte (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Recibe un byte por la uart esperando como mucho timeout microsegundos
+ * Implementación del driver de nivel 0, con la misma semántica que
+ * uart_try_receive_byte
+ * @param uart		Identificador de la uart
+ * @param timeout	Tiempo máximo de espera en microsegundos
+ * @return	El byte como un casting de uint8_t a int32_t en caso de éxito o
+ * 		-1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(ETIMEDOUT si vence el plazo)
+ */
+int32_t uart_receive_byte_timeout (uart_id_t uart, uint32_t timeout);
+
+/*****************************************************************************/
+
 /**
  * Transmisión de bytes
  * Implementación del driver de nivel 1. La llamada es no bloqueante y se realiza mediante interrupciones
@@ -90,8 +392,37 @@ ssize_t uart_receive (uint32_t uart, char *buf, size_t count);
 
 /*****************************************************************************/
 
+/**
+ * Transmisión asíncrona sin copias
+ * Encola un descriptor con un búfer del llamador. La isr vuelca los datos
+ * directamente desde ese búfer a la FIFO, sin pasar por el búfer circular de
+ * transmisión y sin límite de tamaño. Los bytes escritos con uart_send tienen
+ * prioridad sobre los descriptores encolados. No se admite en modo FIQ
+ * @param uart	Identificador de la uart
+ * @param desc	Descriptor de la transmisión. Debe permanecer válido hasta que
+ * 		se invoque su función done
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_send_async (uart_id_t uart, uart_tx_desc_t *desc);
+
+/*****************************************************************************/
+
+/**
+ * Descarta la transmisión pendiente de una uart: vacía el búfer de
+ * transmisión y retira de la cola todos los descriptores, sin invocar sus
+ * funciones done. Los bytes que ya estén en la FIFO sí se transmiten
+ * @param uart	Identificador de la uart
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_cancel_tx (uart_id_t uart);
+
+/*****************************************************************************/
+
 /**
  * Fija la función callback de recepción de una uart
+ * No se admite en modo FIQ
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
  * @return	Cero en caso de éxito o -1 en caso de error.
@@ -103,6 +434,7 @@ int32_t uart_set_receive_callback (uart_id_t uart, uart_callback_t func);
 
 /**
  * Fija la función callback de transmisión de una uart
+ * No se admite en modo FIQ
  * @param uart	Identificador de la uart
  * @param func	Función callback. NULL para anular una selección anterior
  * @return	Cero en caso de éxito o -1 en caso de error.
@@ -112,4 +444,266 @@ int32_t uart_set_send_callback (uart_id_t uart, uart_callback_t func);
 
 /*****************************************************************************/
 
+/**
+ * Selecciona el contexto en el que se ejecutan las callbacks de una uart
+ * En modo diferido la isr sólo anota que hay trabajo pendiente y las
+ * callbacks se ejecutan cuando el programa principal llama a
+ * uart_dispatch_callbacks, una vez por ráfaga aunque haya habido varias
+ * interrupciones. Así el tiempo en la isr está acotado y las callbacks
+ * pueden usar la E/S estándar
+ * @param uart	Identificador de la uart
+ * @param mode	Contexto de ejecución de las callbacks
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_callback_mode (uart_id_t uart, uart_callback_mode_t mode);
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta las callbacks diferidas pendientes de todas las uart
+ * Debe llamarse periódicamente desde el bucle del programa principal
+ * @return	El número de callbacks ejecutadas
+ */
+uint32_t uart_dispatch_callbacks (void);
+
+/*****************************************************************************/
+
+/**
+ * Selecciona qué ocurre cuando se llena el búfer de transmisión de una uart
+ * En modo circular_buffer_mode_overwrite uart_send nunca se queda corta: se
+ * descartan los bytes más antiguos pendientes de enviar, lo que permite que
+ * las trazas y la consola sigan avanzando conservando lo más reciente.
+ * Los bytes descartados se contabilizan en el campo lost de las estadísticas
+ * @param uart	Identificador de la uart
+ * @param mode	Comportamiento del búfer cuando se llena
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_tx_mode (uart_id_t uart, circular_buffer_mode_t mode);
+
+/*****************************************************************************/
+
+/**
+ * Configura el umbral adaptativo de interrupción de recepción de una uart
+ * Usa el temporizador asignado a la uart en system.h para detectar el
+ * silencio en la línea
+ * @param uart	Identificador de la uart
+ * @param thr	Configuración del umbral. NULL fija el umbral a un byte y
+ * 		deshabilita la adaptación
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_rx_threshold (uart_id_t uart, const uart_rx_threshold_t *thr);
+
+/*****************************************************************************/
+
+/**
+ * Selecciona el control de flujo de una uart
+ * Con control de flujo la recepción se detiene cuando el búfer de recepción
+ * llega a 3/4 de su capacidad y se reanuda cuando baja de 1/4.
+ * Con uart_flow_rtscts, mientras está detenida los bytes se acumulan en la
+ * FIFO y el hardware desactiva CTS para que el otro extremo deje de transmitir.
+ * Con uart_flow_xonxoff se envía XOFF y XON al otro extremo y, a su vez, la
+ * transmisión se detiene al recibir XOFF y se reanuda al recibir XON. Estos
+ * dos caracteres se retiran de los datos recibidos, por lo que este modo sólo
+ * es válido para texto
+ * @param uart	Identificador de la uart
+ * @param flow	Modo de control de flujo
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_flow_control (uart_id_t uart, uart_flow_t flow);
+
+/*****************************************************************************/
+
+/**
+ * Activa o desactiva el bucle interno de una uart (bit TST de UCON)
+ * Con el bucle activo lo transmitido se recibe en la propia uart sin pasar
+ * por los pines, lo que permite probar el driver sin hardware adicional
+ * @param uart		Identificador de la uart
+ * @param enable	Distinto de cero para activar el bucle
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_loopback (uart_id_t uart, uint32_t enable);
+
+/*****************************************************************************/
+
+/**
+ * Activa o desactiva el modo FIQ de una uart
+ * En este modo la interrupción de la uart es rápida y un manejador en
+ * ensamblador vacía la FIFO de recepción en el búfer sin guardar ningún
+ * contexto, con los punteros del búfer en los registros propios del modo FIQ.
+ * La transmisión y los errores se siguen atendiendo desde la isr en C.
+ * Sólo una uart puede estar en modo FIQ, y el modo no es compatible con la
+ * recepción por tramas, uart_flow_xonxoff, el umbral adaptativo ni la callback
+ * de recepción, porque el manejador rápido no los atiende. Tampoco admite la
+ * callback de transmisión ni descriptores de uart_send_async, ya que el
+ * código del usuario se ejecutaría en modo FIQ. Las interrupciones
+ * que resuelve el manejador rápido no se contabilizan en interrupts ni en las
+ * estadísticas del búfer de recepción.
+ * Esta función sólo funciona en modos privilegiados
+ * @param uart		Identificador de la uart
+ * @param enable	Distinto de cero para activar el modo FIQ
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_fiq_mode (uart_id_t uart, uint32_t enable);
+
+/*****************************************************************************/
+
+/**
+ * Activa o desactiva la recepción por tramas de una uart
+ * En este modo los bytes recibidos no pasan por el búfer de recepción: se
+ * agrupan en tramas que se obtienen con uart_get_frame, y la callback de
+ * recepción se invoca una vez por trama. La FIFO interrumpe con cada byte y
+ * el temporizador de silencio de la uart, rearmado en cada interrupción,
+ * delimita las tramas. Si no quedan tramas libres la recepción se detiene
+ * hasta que se libere alguna. No es compatible con uart_flow_xonxoff ni con
+ * el modo FIQ
+ * @param uart	Identificador de la uart
+ * @param cfg	Configuración de las tramas. NULL vuelve al modo normal
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_set_frame_mode (uart_id_t uart, const uart_frame_config_t *cfg);
+
+/*****************************************************************************/
+
+/**
+ * Obtiene la trama recibida más antigua de una uart sin retirarla
+ * @param uart	Identificador de la uart
+ * @param frame	Estructura donde se devuelven los datos y la longitud
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(EAGAIN si no hay ninguna trama completa)
+ */
+int32_t uart_get_frame (uart_id_t uart, uart_frame_t *frame);
+
+/*****************************************************************************/
+
+/**
+ * Libera la trama más antigua de una uart, devolviendo su espacio a la isr
+ * @param uart	Identificador de la uart
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_release_frame (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Retorna el espacio libre en el búfer de transmisión de una uart
+ * @param uart	Identificador de la uart
+ * @return	El número de bytes libres en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_get_tx_space (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Retorna las estadísticas de los búferes de una uart
+ * @param uart	Identificador de la uart
+ * @param rx	Estadísticas del búfer de recepción. Puede ser NULL
+ * @param tx	Estadísticas del búfer de transmisión. Puede ser NULL
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_get_buffer_stats (uart_id_t uart, circular_buffer_stats_t *rx, circular_buffer_stats_t *tx);
+
+/*****************************************************************************/
+
+/**
+ * Reinicia las estadísticas de los búferes de una uart
+ * @param uart	Identificador de la uart
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_reset_buffer_stats (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Retorna los contadores de errores y actividad de una uart
+ * @param uart	Identificador de la uart
+ * @param stats	Estructura donde se copian los contadores
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_get_stats (uart_id_t uart, uart_stats_t *stats);
+
+/*****************************************************************************/
+
+/**
+ * Reinicia los contadores de errores y actividad de una uart
+ * @param uart	Identificador de la uart
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_reset_stats (uart_id_t uart);
+
+/*****************************************************************************/
+
+/**
+ * Función fstat del dispositivo
+ * Además de indicar que es un dispositivo de caracteres, st_size es el número
+ * de bytes que se pueden leer sin esperar, st_blksize el tamaño del búfer de
+ * recepción y st_blocks el total de errores de línea (FE, PE, SE y ROE)
+ * @param uart	Identificador de la uart
+ * @param buf	Estructura stat a rellenar
+ * @return	Cero en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int uart_fstat (uint32_t uart, struct stat *buf);
+
+/*****************************************************************************/
+
+/**
+ * Transmisión de una trama SLIP (RFC 1055) con CRC-16-CCITT
+ * Añade el CRC, escapa los datos y escribe la trama completa directamente en
+ * el búfer de transmisión, así que la isr nunca ve una trama a medias. Como
+ * uart_send, no es bloqueante: si la trama no cabe entera no se escribe nada
+ * @param uart	Identificador de la uart
+ * @param buf	Datos de la trama
+ * @param count	Número de bytes de la trama
+ * @return	El número de bytes de la trama en caso de éxito o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ * 		(EAGAIN si ahora no hay sitio para la trama)
+ */
+ssize_t uart_slip_send (uint32_t uart, char *buf, size_t count);
+
+/*****************************************************************************/
+
+/**
+ * Recepción de una trama SLIP (RFC 1055) con CRC-16-CCITT
+ * Decodifica directamente desde el búfer de recepción la siguiente trama
+ * completa. Las tramas con un CRC o un escape incorrecto, o que no caben en
+ * buf, se descartan y se contabilizan en las estadísticas de la uart.
+ * La llamada es no bloqueante
+ * @param uart	Identificador de la uart
+ * @param buf	Búfer para almacenar la trama
+ * @param count	Tamaño del búfer
+ * @return	El número de bytes de la trama, cero si no hay ninguna completa o
+ * 		-1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+ssize_t uart_slip_receive (uint32_t uart, char *buf, size_t count);
+
+/*****************************************************************************/
+
+/**
+ * Registra un dispositivo que transmite y recibe tramas SLIP con CRC sobre
+ * una uart ya inicializada. Comparte los búferes con el dispositivo de la
+ * uart, por lo que no deben usarse a la vez
+ * @param uart	Identificador de la uart
+ * @param name	Nombre del dispositivo
+ * @return	El número de dispositivo asignado o -1 en caso de error.
+ * 		La condición de error se indica en la variable global errno
+ */
+int32_t uart_slip_register (uart_id_t uart, const char *name);
+
+/*****************************************************************************/
+
 #endif /* __UART_H__ */
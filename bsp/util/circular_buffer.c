@@ -3,96 +3,240 @@
  * Búfer circular
  */
 
+#include <string.h>
 #include "circular_buffer.h"
 
 /*****************************************************************************/
 
 /**
  * Inicializa un búfer circular dado un puntero a una zona de memoria y su tamaño
+ * Si el tamaño no es una potencia de dos se usa la mayor potencia de dos que
+ * quepa en la zona de memoria
  * @param cb	Puntero a la estructura de gestión del búfer circular
  * @param addr	Puntero a la zona de memoria que se gestionará como un búfer circular
  * @param size	Tamaño en bytes del búfer
  */
 void circular_buffer_init (volatile circular_buffer_t *cb, uint8_t *addr, uint32_t size)
 {
+	/* Nos quedamos con el bit más significativo del tamaño */
+	while (size & (size - 1))
+		size &= size - 1;
+
 	cb->data = addr;
 	cb->size = size;
+	cb->mask = size - 1;
 	cb->start = 0;
 	cb->end = 0;
-	cb->count = 0;
+	cb->mode = circular_buffer_mode_drop;
+
+	circular_buffer_reset_stats (cb);
 }
 
 /*****************************************************************************/
 
 /**
- * Retorna 1 si el búfer está lleno
+ * Selecciona el comportamiento del búfer cuando se llena
+ * Debe llamarse antes de que el productor y el consumidor empiecen a usarlo
  * @param cb	Búfer circular
+ * @param mode	circular_buffer_mode_drop para rechazar los datos nuevos o
+ * 				circular_buffer_mode_overwrite para sobrescribir los antiguos
  */
-inline uint32_t circular_buffer_is_full (volatile circular_buffer_t *cb)
+void circular_buffer_set_mode (volatile circular_buffer_t *cb, circular_buffer_mode_t mode)
 {
-    return cb->count == cb->size;
+	cb->mode = mode;
 }
 
 /*****************************************************************************/
 
 /**
- * Retorna 1 si el búfer está vacío
+ * Retorna el número de bytes sobrescritos antes de que el consumidor los leyera
+ * Sólo tiene sentido en modo sobrescritura
  * @param cb	Búfer circular
  */
-inline uint32_t circular_buffer_is_empty (volatile circular_buffer_t *cb)
+uint32_t circular_buffer_lost (volatile circular_buffer_t *cb)
 {
-    return cb->count == 0;
+	return cb->lost;
 }
 
 /*****************************************************************************/
 
 /**
- * Escribe un byte en un búfer circular
+ * Descarta los bytes que el productor ha sobrescrito en modo sobrescritura
+ * El productor puede estar escribiendo la posición end sin haberla publicado,
+ * lo que afecta al byte más antiguo cuando el búfer está completo. Por eso el
+ * consumidor sólo considera válidos los size - 1 bytes más recientes
+ * Sólo debe llamarla el consumidor
  * @param cb	Búfer circular
- * @param byte	Byte a escribir
- * @return		El byte como un casting de uint8_t a int32_t en caso de éxito
- * 				o -1 en caso de error
  */
-int32_t circular_buffer_write (volatile circular_buffer_t *cb, uint8_t byte)
+void __circular_buffer_resync (volatile circular_buffer_t *cb)
 {
-    /* Escribimos en el búfer sólo si hay espacio */
-    if (circular_buffer_is_full (cb))
-    	return -1;
-    else
-    {
-        cb->data[cb->end] = byte;
-        cb->count++;
-
-        cb->end++;
-    	if (cb->end == cb->size)
-    		cb->end = 0;
-        return byte;
-    }
+	uint32_t start = cb->start;
+	uint32_t end = cb->end;
+
+	if (end - start >= cb->size)
+	{
+		cb->lost += end - (cb->size - 1) - start;
+		cb->start = end - (cb->size - 1);
+	}
 }
 
 /*****************************************************************************/
 
 /**
- * Lee un byte en un búfer circular
+ * Lee un byte de un búfer en modo sobrescritura
+ * Tras leer el byte se comprueba que el productor no lo haya sobrescrito
+ * mientras tanto. Si lo ha hecho se descarta y se vuelve a intentar
+ * Sólo debe llamarla el consumidor
  * @param cb	Búfer circular
  * @return		El byte como un casting de uint8_t a int32_t en caso de éxito
- * 				o -1 en caso de error
+ * 				o -1 si el búfer está vacío
  */
-int32_t circular_buffer_read (volatile circular_buffer_t *cb)
+int32_t __circular_buffer_read_overwrite (volatile circular_buffer_t *cb)
 {
 	int32_t byte;
-    if (circular_buffer_is_empty (cb))
-    	return -1;
-    else
-    {
-        byte = cb->data[cb->start];
-        cb->count--;
-
-        cb->start++;
-    	if (cb->start == cb->size)
-    		cb->start = 0;
-        return byte;
-    }
+	uint32_t start;
+
+	for (;;)
+	{
+		__circular_buffer_resync (cb);
+
+		start = cb->start;
+		if (cb->end == start)
+			return -1;
+
+		/* El dato no se puede leer antes que el índice que lo publica */
+		CIRCULAR_BUFFER_BARRIER ();
+		byte = cb->data[start & cb->mask];
+
+		/* Comprobamos que el productor no haya llegado a esta posición */
+		CIRCULAR_BUFFER_BARRIER ();
+		if (cb->end - start < cb->size)
+			break;
+	}
+
+	cb->start = start + 1;
+	__circular_buffer_stats_out (cb, 1);
+	return byte;
+}
+
+/*****************************************************************************/
+
+/**
+ * Escribe un bloque de bytes en un búfer circular
+ * Copia los datos en, como mucho, dos regiones contiguas del búfer
+ * Sólo debe llamarla el productor
+ * @param cb	Búfer circular
+ * @param src	Bytes a escribir
+ * @param count	Número de bytes a escribir
+ * @return		El número de bytes escritos, que puede ser menor que count si
+ * 				no hay espacio suficiente
+ */
+uint32_t circular_buffer_write_span (volatile circular_buffer_t *cb, const uint8_t *src, uint32_t count)
+{
+	uint8_t *addr;
+	uint32_t len, written = 0;
+
+	/*
+	 * Como mucho hay dos regiones libres: hasta el final del búfer y desde el principio.
+	 * En modo sobrescritura, con el búfer lleno, se avanza de byte en byte
+	 */
+	while (written < count && (len = circular_buffer_peek_contiguous (cb, &addr)) > 0)
+	{
+		if (len > count - written)
+			len = count - written;
+
+		memcpy (addr, src + written, len);
+		circular_buffer_commit (cb, len);
+		written += len;
+	}
+
+	if (written < count)
+		circular_buffer_stats_overflow (cb, count - written);
+
+	return written;
+}
+
+/*****************************************************************************/
+
+/**
+ * Lee un bloque de bytes de un búfer circular
+ * Copia los datos desde, como mucho, dos regiones contiguas del búfer
+ * Sólo debe llamarla el consumidor
+ * @param cb	Búfer circular
+ * @param dst	Búfer donde se almacenarán los bytes leídos
+ * @param count	Número de bytes a leer
+ * @return		El número de bytes leídos, que puede ser menor que count si
+ * 				el búfer no tiene suficientes datos
+ */
+uint32_t circular_buffer_read_span (volatile circular_buffer_t *cb, uint8_t *dst, uint32_t count)
+{
+	uint8_t *addr;
+	uint32_t len, read = 0;
+	int32_t byte;
+
+	/* En modo sobrescritura hay que validar cada byte tras leerlo */
+	if (cb->mode == circular_buffer_mode_overwrite)
+	{
+		while (read < count && (byte = __circular_buffer_read_overwrite (cb)) >= 0)
+			dst[read++] = byte;
+
+		return read;
+	}
+
+	/* Como mucho hay dos regiones con datos: hasta el final del búfer y desde el principio */
+	while (read < count && (len = circular_buffer_peek_data (cb, &addr)) > 0)
+	{
+		if (len > count - read)
+			len = count - read;
+
+		memcpy (dst + read, addr, len);
+		circular_buffer_consume (cb, len);
+		read += len;
+	}
+
+	return read;
+}
+
+/*****************************************************************************/
+
+
+/**
+ * Retorna las estadísticas de un búfer circular
+ * Si las estadísticas están deshabilitadas se retornan a cero
+ * @param cb	Búfer circular
+ * @param stats	Estructura donde se copian las estadísticas
+ */
+void circular_buffer_get_stats (volatile circular_buffer_t *cb, circular_buffer_stats_t *stats)
+{
+#if CIRCULAR_BUFFER_STATS
+	stats->high_water = cb->stats.high_water;
+	stats->overflows = cb->stats.overflows;
+	stats->bytes_in = cb->stats.bytes_in;
+	stats->bytes_out = cb->stats.bytes_out;
+#else
+	memset (stats, 0, sizeof (circular_buffer_stats_t));
+#endif
+	stats->lost = cb->lost;
+}
+
+/*****************************************************************************/
+
+/**
+ * Reinicia las estadísticas de un búfer circular
+ * @param cb	Búfer circular
+ */
+void circular_buffer_reset_stats (volatile circular_buffer_t *cb)
+{
+#if CIRCULAR_BUFFER_STATS
+	uint32_t used = cb->end - cb->start;
+
+	/* En modo sobrescritura el productor puede adelantar al consumidor */
+	cb->stats.high_water = used > cb->size ? cb->size : used;
+	cb->stats.overflows = 0;
+	cb->stats.bytes_in = 0;
+	cb->stats.bytes_out = 0;
+#endif
+	cb->lost = 0;
 }
 
 /*****************************************************************************/
@@ -39,6 +39,9 @@
 #include <string.h>
 #include <stdint.h>
 
+/* 'U' bursts sent by -y before giving up, 10 ms apart */
+#define SYNC_RETRIES 1000
+
 
 char* filename;
 char* second;
@@ -53,6 +56,38 @@ int do_exit = 0;
 int zerolen = 0;
 int ownlen = 0;
 char *args = NULL;
+int autobaud = 0;
+
+/* Baud rates accepted by -u */
+struct {
+  const char *name;
+  speed_t speed;
+} bauds[] = {
+  {"9600", B9600},
+  {"19200", B19200},
+  {"38400", B38400},
+  {"57600", B57600},
+  {"115200", B115200},
+#ifdef B230400
+  {"230400", B230400},
+#endif
+#ifdef B460800
+  {"460800", B460800},
+#endif
+#ifdef B921600
+  {"921600", B921600},
+#endif
+#ifdef B1000000
+  {"1000000", B1000000},
+#endif
+#ifdef B1500000
+  {"1500000", B1500000},
+#endif
+#ifdef B2000000
+  {"2000000", B2000000},
+#endif
+  {NULL, 0}
+};
 
 struct stat sbuf;
 struct termios options;
@@ -63,6 +98,7 @@ int sfd;
 
 void help(void);
 void waitFor(const char *needle, const char sendZero);
+void syncBaud(void);
 
 int main(int argc, char **argv) {
   int c = 0;
@@ -72,7 +108,7 @@ int main(int argc, char **argv) {
   opterr = 0;
 
   /* Parse options */
-  while ((c = getopt(argc, argv, "f:s:zlt:vu:r:c:a:b:eh")) != -1) {
+  while ((c = getopt(argc, argv, "f:s:zlt:vu:r:c:a:b:eyh")) != -1) {
     switch (c)
     {
       case 'f':
@@ -94,18 +130,18 @@ int main(int argc, char **argv) {
         verbose = 1;
         break;
       case 'u':
-        if (strcmp(optarg, "115200")) {
-          baud = B115200;
-        } else if (strcmp(optarg, "57600")) {
-          baud = B115200;
-        } else if (strcmp(optarg, "19200")) {
-          baud = B19200;
-        } else if (strcmp(optarg, "9600")) {
-          baud = B9600;
-        } else {
+        for (i = 0; bauds[i].name; i++)
+          if (!strcmp(optarg, bauds[i].name))
+            break;
+        if (!bauds[i].name) {
           printf("Unknown baud rate %s!\n", optarg);
           return -1;
         }
+        baud = bauds[i].speed;
+        i = 0;
+        break;
+      case 'y':
+        autobaud = 1;
         break;
       case 'r':
         rts = optarg;
@@ -144,6 +180,7 @@ int main(int argc, char **argv) {
     printf("Flow control: %s\n", rts);
     printf("Reset command: %s\n", command);
     printf("Exit after load: %s\n", do_exit == 1 ? "Yes" : "No");
+    printf("Autobaud sync: %s\n", autobaud == 1 ? "Yes" : "No");
     printf("Delay 1: %i\n", first_delay);
     printf("Delay 2: %i\n", second_delay);
   }
@@ -157,6 +194,7 @@ int main(int argc, char **argv) {
   fcntl(pfd, F_SETFL, FNDELAY);
   tcgetattr(pfd, &options);
   cfsetispeed(&options, baud);
+  cfsetospeed(&options, baud);
   options.c_cflag |= (CLOCAL | CREAD);
   options.c_cflag &= ~PARENB;
   options.c_cflag &= ~CSTOPB;
@@ -264,6 +302,10 @@ int main(int argc, char **argv) {
   /* Wait for flasher done */
   waitFor("flasher done", 0);
 
+  /* Let the firmware detect our baud rate */
+  if (autobaud)
+    syncBaud();
+
   /* Send the remaining arguments */
   if (args) {
     printf("Sending %s\n", args);
@@ -297,6 +339,9 @@ void help(void)
   printf("       -l optional: secondary file contains len in first 4 Bytes (little endian)\n");
   printf("       -t, terminal default: /dev/ttyUSB0\n");
   printf("       -u, baud rate default: 115200\n");
+  printf("              9600 to 2000000, depending on the host\n");
+  printf("       -y send 'U' sync characters after loading until the board\n");
+  printf("              answers (10 s at most), for firmware that detects the baud rate\n");
   printf("       -r [none|rts] flow control default: none\n");
   printf("       -c command to run for autoreset: \n");
   printf("              e.g. -c 'bbmc -l redbee-econotag -i 0 reset'\n");
@@ -334,3 +379,34 @@ void waitFor(const char *needle, const char sendZero)
     }
   }
 }
+
+
+void syncBaud(void)
+{
+  int r = 0;
+  int n = 0;
+
+  /*
+   * Send bursts of 'U' (0x55) every 10 ms until the board prints something.
+   * Its bits alternate, which is what the firmware autobaud measures.
+   * Give up after SYNC_RETRIES bursts if the board never answers.
+   */
+  printf("Sending autobaud sync...\n");
+  while (1) {
+    if (n >= SYNC_RETRIES) {
+      printf("\nNo answer from the board after %i sync bursts\n", n);
+      exit(EXIT_FAILURE);
+    }
+    write(pfd, (const void*)"UUUUUUUU", 8);
+    usleep(10000);
+    r = read(pfd, buf, sizeof(buf)-1);
+    if (r > 0) {
+      buf[r] = '\0';
+      printf("%s", buf); fflush(stdout);
+      break;
+    }
+    if (++n % 100 == 0) {
+      printf("."); fflush(stdout);
+    }
+  }
+}
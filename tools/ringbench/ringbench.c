@@ -0,0 +1,489 @@
+/*
+ * Sistemas operativos empotrados
+ * Banco de pruebas del búfer circular del BSP en el host
+ *
+ * Compila bsp/util/circular_buffer.c de forma nativa y:
+ *  - Mide el rendimiento (ns/byte) de las operaciones byte a byte frente a las
+ *    operaciones en bloque para distintos tamaños de búfer
+ *  - Ejecuta una prueba de estrés con un hilo productor y otro consumidor que
+ *    simula el reparto isr/programa principal y comprueba que no se pierden,
+ *    duplican ni desordenan bytes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "circular_buffer.h"
+
+/*****************************************************************************/
+
+/**
+ * Tamaño máximo de búfer probado
+ */
+#define MAX_SIZE		4096
+
+/**
+ * Bytes transferidos en cada medida de rendimiento
+ */
+#define BENCH_BYTES		(64u << 20)
+
+/**
+ * Bytes transferidos por cada tamaño en la prueba de estrés
+ */
+#define STRESS_BYTES	(4u << 20)
+
+/**
+ * Tamaño de los bloques usados en las operaciones en bloque
+ */
+#define CHUNK			64
+
+static uint8_t storage[MAX_SIZE];
+static uint8_t chunk[MAX_SIZE];
+static volatile circular_buffer_t cb;
+
+/**
+ * Versiones de tamaño fijo para comparar con las de tamaño en tiempo de ejecución
+ */
+DEFINE_RING(r64, 64)
+DEFINE_RING(r256, 256)
+DEFINE_RING(r1024, 1024)
+DEFINE_RING(r4096, 4096)
+
+/*****************************************************************************/
+
+/**
+ * Retorna el instante actual en nanosegundos
+ */
+static uint64_t now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/*****************************************************************************/
+
+/**
+ * Transferencia byte a byte con circular_buffer_write/read
+ */
+static void bench_byte (uint32_t size)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < BENCH_BYTES; i += size / 2)
+	{
+		for (j = 0; j < size / 2; j++)
+			circular_buffer_write (&cb, (uint8_t) j);
+		for (j = 0; j < size / 2; j++)
+			circular_buffer_read (&cb);
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Transferencia byte a byte con las operaciones generadas por DEFINE_RING
+ */
+#define BENCH_RING(name)									\
+static void bench_##name (uint32_t size)					\
+{															\
+	uint32_t i, j;											\
+															\
+	for (i = 0; i < BENCH_BYTES; i += size / 2)				\
+	{														\
+		for (j = 0; j < size / 2; j++)						\
+			name##_ring_write (&cb, (uint8_t) j);			\
+		for (j = 0; j < size / 2; j++)						\
+			name##_ring_read (&cb);							\
+	}														\
+}
+
+BENCH_RING(r64)
+BENCH_RING(r256)
+BENCH_RING(r1024)
+BENCH_RING(r4096)
+
+static void bench_fixed (uint32_t size)
+{
+	switch (size)
+	{
+	case 64:	bench_r64 (size);	break;
+	case 256:	bench_r256 (size);	break;
+	case 1024:	bench_r1024 (size);	break;
+	case 4096:	bench_r4096 (size);	break;
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Transferencia en bloques con circular_buffer_write_span/read_span
+ */
+static void bench_span (uint32_t size)
+{
+	uint32_t i, j, len = size / 2 < CHUNK ? size / 2 : CHUNK;
+
+	for (i = 0; i < BENCH_BYTES; i += size / 2)
+	{
+		for (j = 0; j < size / 2; j += len)
+			circular_buffer_write_span (&cb, chunk, len);
+		for (j = 0; j < size / 2; j += len)
+			circular_buffer_read_span (&cb, chunk, len);
+	}
+}
+
+/*****************************************************************************/
+
+/**
+ * Transferencia sin copias con peek/commit, rellenando el búfer byte a byte
+ * como lo hace la isr desde la FIFO
+ */
+static void bench_peek (uint32_t size)
+{
+	uint8_t *addr;
+	uint32_t i, j, len;
+	volatile uint8_t sink;
+
+	for (i = 0; i < BENCH_BYTES; i += size / 2)
+	{
+		for (j = 0; j < size / 2; j += len)
+		{
+			len = circular_buffer_peek_contiguous (&cb, &addr);
+			if (len > size / 2 - j)
+				len = size / 2 - j;
+			memset (addr, (int) j, len);
+			circular_buffer_commit (&cb, len);
+		}
+		for (j = 0; j < size / 2; j += len)
+		{
+			len = circular_buffer_peek_data (&cb, &addr);
+			if (len > size / 2 - j)
+				len = size / 2 - j;
+			sink = addr[len - 1];
+			circular_buffer_consume (&cb, len);
+		}
+	}
+	(void) sink;
+}
+
+/*****************************************************************************/
+
+/**
+ * Mide una operación y retorna su coste en ns/byte
+ */
+static double measure (void (*bench)(uint32_t), uint32_t size)
+{
+	uint64_t t;
+
+	circular_buffer_init (&cb, storage, size);
+	t = now_ns ();
+	bench (size);
+	t = now_ns () - t;
+
+	return (double) t / BENCH_BYTES;
+}
+
+/*****************************************************************************/
+
+/**
+ * Mide el rendimiento de todas las operaciones para distintos tamaños
+ */
+static void run_bench (void)
+{
+	static const uint32_t sizes[] = {64, 256, 1024, 4096};
+	uint32_t i;
+
+	printf ("Rendimiento (ns/byte, %u MiB por medida)\n", BENCH_BYTES >> 20);
+	printf ("%8s %12s %12s %12s %12s\n", "tamaño", "byte", "DEFINE_RING", "span", "peek/commit");
+
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+		printf ("%8u %12.3f %12.3f %12.3f %12.3f\n", sizes[i],
+				measure (bench_byte, sizes[i]),
+				measure (bench_fixed, sizes[i]),
+				measure (bench_span, sizes[i]),
+				measure (bench_peek, sizes[i]));
+}
+
+/*****************************************************************************/
+
+/**
+ * Estado de la prueba de estrés
+ */
+static volatile uint32_t stress_errors;
+
+/**
+ * Generador pseudoaleatorio por hilo
+ */
+static uint32_t next_rand (uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/**
+ * Byte que ocupa la posición pos de la secuencia de la prueba de estrés.
+ * Con un hash, a diferencia de pos & 0xff, un salto de un múltiplo de 256
+ * bytes no pasa desapercibido
+ */
+static inline uint8_t pattern (uint32_t pos)
+{
+	return (pos * 0x9e3779b1u) >> 24;
+}
+
+/**
+ * En modo sobrescritura el productor sólo escribe más de lo que cabe en uno
+ * de cada OVERWRITE_ODDS bloques; en el resto espera al consumidor. Así la
+ * pérdida es ocasional y se ejercita la resincronización con datos fluyendo
+ */
+#define OVERWRITE_ODDS	32
+
+/**
+ * Total de bytes que el consumidor ha visto saltarse en la secuencia
+ */
+static volatile uint32_t stress_gaps;
+
+/*****************************************************************************/
+
+/**
+ * Hilo productor. Escribe una secuencia conocida alternando escrituras byte a
+ * byte, en bloque y con peek/commit, como harían la isr de recepción o
+ * uart_send
+ */
+static void *producer (void *arg)
+{
+	uint32_t seed = 0x12345678, sent = 0, chunks = 0, len, room, i;
+	uint8_t buf[CHUNK], *addr;
+
+	(void) arg;
+
+	while (sent < STRESS_BYTES)
+	{
+		/* Con el búfer lleno cedemos la CPU, como haría la isr al enmascararse */
+		if (circular_buffer_is_full (&cb))
+			sched_yield ();
+
+		len = next_rand (&seed) % CHUNK + 1;
+		if (len > STRESS_BYTES - sent)
+			len = STRESS_BYTES - sent;
+
+		/* En modo sobrescritura sólo se escribe más de lo que cabe de vez en cuando */
+		if (cb.mode == circular_buffer_mode_overwrite && ++chunks % OVERWRITE_ODDS != 0)
+		{
+			/*
+			 * Esperamos a que quepa el bloque o medio búfer, para no alternar
+			 * con el consumidor byte a byte
+			 */
+			room = cb.size - circular_buffer_count (&cb);
+			if (room < len && room < cb.size / 2)
+			{
+				/* El turno de sobrescribir no se gasta esperando */
+				chunks--;
+				sched_yield ();
+				continue;
+			}
+			if (len > room)
+				len = room;
+		}
+
+		switch (next_rand (&seed) % 3)
+		{
+		case 0:
+			if (circular_buffer_write (&cb, pattern (sent)) >= 0)
+				sent++;
+			break;
+
+		case 1:
+			for (i = 0; i < len; i++)
+				buf[i] = pattern (sent + i);
+			sent += circular_buffer_write_span (&cb, buf, len);
+			break;
+
+		case 2:
+			i = circular_buffer_peek_contiguous (&cb, &addr);
+			len = len < i ? len : i;
+			for (i = 0; i < len; i++)
+				addr[i] = pattern (sent + i);
+			circular_buffer_commit (&cb, len);
+			sent += len;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*****************************************************************************/
+
+/**
+ * Hilo consumidor. Lee y comprueba la secuencia alternando lecturas byte a
+ * byte, en bloque y con peek/consume, como harían uart_receive o la isr de
+ * transmisión
+ */
+static void *consumer (void *arg)
+{
+	uint32_t seed = 0x9abcdef0, received = 0, lost = 0, len, i;
+	uint8_t buf[CHUNK], *addr;
+	int32_t byte;
+
+	(void) arg;
+
+	while (received + circular_buffer_lost (&cb) < STRESS_BYTES)
+	{
+		/* Con el búfer vacío cedemos la CPU, como haría el programa principal */
+		if (circular_buffer_is_empty (&cb))
+			sched_yield ();
+
+		/*
+		 * En modo sobrescritura la posición de cada byte leído es el número de
+		 * bytes leídos más los perdidos hasta ese momento, así que se lee de
+		 * byte en byte para poder comprobarla
+		 */
+		if (cb.mode == circular_buffer_mode_overwrite)
+		{
+			byte = circular_buffer_read (&cb);
+			if (byte >= 0)
+			{
+				/* Localizamos el byte en la secuencia a partir del último leído */
+				for (len = 0; len <= MAX_SIZE && byte != pattern (received + lost + len); len++)
+					;
+				if (len > MAX_SIZE)
+					stress_errors++;
+				else
+					lost += len;
+
+				/* El salto visto en los datos debe coincidir con lo contabilizado */
+				if (lost != circular_buffer_lost (&cb))
+					stress_errors++;
+				received++;
+			}
+			continue;
+		}
+
+		len = next_rand (&seed) % CHUNK + 1;
+
+		switch (next_rand (&seed) % 3)
+		{
+		case 0:
+			byte = circular_buffer_read (&cb);
+			if (byte >= 0)
+			{
+				if (byte != pattern (received))
+					stress_errors++;
+				received++;
+			}
+			break;
+
+		case 1:
+			len = circular_buffer_read_span (&cb, buf, len);
+			for (i = 0; i < len; i++)
+				if (buf[i] != pattern (received + i))
+					stress_errors++;
+			received += len;
+			break;
+
+		case 2:
+			i = circular_buffer_peek_data (&cb, &addr);
+			len = len < i ? len : i;
+			for (i = 0; i < len; i++)
+				if (addr[i] != pattern (received + i))
+					stress_errors++;
+			circular_buffer_consume (&cb, len);
+			received += len;
+			break;
+		}
+	}
+
+	stress_gaps = lost;
+	return NULL;
+}
+
+/*****************************************************************************/
+
+/**
+ * Ejecuta la prueba de estrés para distintos tamaños de búfer
+ * @param mode	Comportamiento del búfer cuando se llena
+ * @return	El número de errores detectados
+ */
+static uint32_t run_stress (circular_buffer_mode_t mode)
+{
+	static const uint32_t sizes[] = {16, 64, 256, 1024, 4096};
+	circular_buffer_stats_t stats;
+	pthread_t prod, cons;
+	uint32_t i, errors = 0;
+
+	printf ("Estrés productor/consumidor, modo %s (%u MiB por tamaño)\n",
+			mode == circular_buffer_mode_drop ? "descarte" : "sobrescritura",
+			STRESS_BYTES >> 20);
+
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+	{
+		stress_errors = 0;
+		stress_gaps = 0;
+		circular_buffer_init (&cb, storage, sizes[i]);
+		circular_buffer_set_mode (&cb, mode);
+
+		pthread_create (&prod, NULL, producer, NULL);
+		pthread_create (&cons, NULL, consumer, NULL);
+		pthread_join (prod, NULL);
+		pthread_join (cons, NULL);
+
+		circular_buffer_get_stats (&cb, &stats);
+		if (!circular_buffer_is_empty (&cb))
+			stress_errors++;
+#if CIRCULAR_BUFFER_STATS
+		if (stats.bytes_in != STRESS_BYTES || stats.bytes_out + stats.lost != STRESS_BYTES ||
+				stats.high_water > sizes[i])
+			stress_errors++;
+#endif
+		/* La pérdida debe ser ocasional y cuadrar con los saltos de la secuencia */
+		if (mode == circular_buffer_mode_overwrite &&
+				(stats.lost != stress_gaps || stats.lost > STRESS_BYTES / 2))
+			stress_errors++;
+
+		printf ("%8u: %s (máximo ocupado %u, rechazados %u, perdidos %u)\n", sizes[i],
+				stress_errors ? "FALLO" : "ok", stats.high_water, stats.overflows, stats.lost);
+		errors += stress_errors;
+	}
+
+	return errors;
+}
+
+/*****************************************************************************/
+
+int main (int argc, char *argv[])
+{
+	uint32_t errors = 0;
+	int bench = 1, stress = 1;
+
+	if (argc > 1)
+	{
+		bench = !strcmp (argv[1], "bench");
+		stress = !strcmp (argv[1], "stress");
+		if (!bench && !stress)
+		{
+			fprintf (stderr, "Uso: %s [bench|stress]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (bench)
+		run_bench ();
+
+	if (stress)
+	{
+		errors = run_stress (circular_buffer_mode_drop);
+		errors += run_stress (circular_buffer_mode_overwrite);
+	}
+
+	return errors ? 1 : 0;
+}
+
+/*****************************************************************************/